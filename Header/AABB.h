@@ -0,0 +1,67 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "VecN.h"
+#include "RayN.h"
+
+// per ray values of the slab test, computed once and reused for every box the ray meets
+template <int D, typename T>
+struct RayPrepN {
+    VecN<D, T> origin;
+    VecN<D, T> inv_dir;
+    int sign[D];    // 1 where the direction is negative, indexes the plane the ray enters first
+
+    RayPrepN(const RayN<D, T>& r) : origin(r.origin()) {
+        for (int a = 0; a < D; a++) {
+            inv_dir[a] = 1 / r.direction()[a];
+            sign[a] = inv_dir[a] < 0;
+        }
+    }
+};
+
+// axis aligned box in D dimensions, BoundingBox and BoundingBox4 are AABB<3, double> and AABB<4, double>
+template <int D, typename T>
+class AABB {
+    public:
+        AABB() {}
+        AABB(const VecN<D, T>& a, const VecN<D, T>& b) { bounds[0] = a; bounds[1] = b; }
+
+        VecN<D, T> min() const { return bounds[0]; }
+        VecN<D, T> max() const { return bounds[1]; }
+
+        bool hit(const RayN<D, T>& r, T tmin, T tmax) const {
+            for (int a = 0; a < D; a++) {
+                auto invD = 1 / r.direction()[a];
+                auto t0 = (bounds[0][a] - r.origin()[a]) * invD;
+                auto t1 = (bounds[1][a] - r.origin()[a]) * invD;
+                if (invD < 0)
+                    std::swap(t0, t1);
+                tmin = t0 > tmin ? t0 : tmin;
+                tmax = t1 < tmax ? t1 : tmax;
+                if (tmax <= tmin)
+                    return false;
+            }
+            return true;
+        }
+
+        // same test without the divisions and the sign branches
+        bool hit(const RayPrepN<D, T>& r, T tmin, T tmax) const {
+            for (int a = 0; a < D; a++) {
+                T t0 = (bounds[r.sign[a]][a] - r.origin[a]) * r.inv_dir[a];
+                T t1 = (bounds[1 - r.sign[a]][a] - r.origin[a]) * r.inv_dir[a];
+                tmin = t0 > tmin ? t0 : tmin;
+                tmax = t1 < tmax ? t1 : tmax;
+            }
+            return tmin < tmax;
+        }
+
+    private:
+        VecN<D, T> bounds[2];   // min, max
+};
+
+template <int D, typename T>
+AABB<D, T> surrounding_box(const AABB<D, T>& box0, const AABB<D, T>& box1) {
+    return AABB<D, T>(vmin(box0.min(), box1.min()), vmax(box0.max(), box1.max()));
+}
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef BVH4_H
+#define BVH4_H
+
+#include "Renderer.h"
+#include "Hittable.h"
+#include "Hittable_List.h"
+#include "LinearBVH.h"
+#include "SlabTest.h"
+#include "TraceStats.h"
+
+#include <cstdint>
+
+// 4 wide BVH: a node holds the boxes of up to four children side by side, so one
+// slab_test4 call tests all of them. built by collapsing the binary tree of BVHBuilder.
+struct alignas(64) BVH4Node {
+    SlabBoxes4 boxes;
+    int32_t child[4];       // node index, or ~first primitive for a leaf
+    uint16_t count[4];      // primitives of a leaf child, 0 for inner nodes and unused lanes
+};
+
+class BVH4 : public Hittable {
+    public:
+        BVH4() {}
+        BVH4(const Hittable_List& list, const BVHBuildOptions& build_options = BVHBuildOptions())
+            : BVH4(list.objects, build_options)
+        {}
+        BVH4(const std::vector<shared_ptr<Hittable>>& objects, const BVHBuildOptions& build_options = BVHBuildOptions());
+
+        virtual bool hit(const Ray& r, double tmin, double tmax, hit_record& rec) const override;
+
+        virtual bool bounding_box(double t0, double t1, BoundingBox& output_box) const override;
+
+        size_t node_count() const { return nodes.size(); }
+
+    private:
+        int32_t collapse(const std::vector<BVHFlatNode<3>>& flat, uint32_t n);
+
+    public:
+        std::vector<BVH4Node> nodes;
+        std::vector<shared_ptr<Hittable>> primitives;   // in leaf order
+        BoundingBox box;
+};
+
+BVH4::BVH4(const std::vector<shared_ptr<Hittable>>& objects, const BVHBuildOptions& build_options) {
+    if (objects.empty()) return;
+
+    std::vector<BVHBuildPrimitive<3>> prims(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        BoundingBox b;
+        if (!objects[i]->bounding_box(0, 0, b))
+            std::cerr << "No bounding box in BVH4 constructor.\n";
+        for (int a = 0; a < 3; a++) {
+            prims[i].box.lo[a] = b.min()[a];
+            prims[i].box.hi[a] = b.max()[a];
+            prims[i].centroid[a] = 0.5 * (b.min()[a] + b.max()[a]);
+        }
+        prims[i].index = (uint32_t)i;
+    }
+
+    BVHBuilder<3> builder(build_options);
+    std::vector<BVHFlatNode<3>> flat = builder.build(prims);
+
+    primitives.resize(prims.size());
+    for (size_t i = 0; i < prims.size(); i++) {
+        primitives[i] = objects[prims[i].index];
+    }
+
+    const BVHBounds<3>& root = flat[0].bounds;
+    box = BoundingBox(Point3(root.lo[0], root.lo[1], root.lo[2]), Point3(root.hi[0], root.hi[1], root.hi[2]));
+    nodes.reserve(flat.size() / 2 + 1);
+    collapse(flat, 0);
+}
+
+// one BVH4 node for binary node n: its two children are opened up, the largest inner one
+// first, until there are four
+int32_t BVH4::collapse(const std::vector<BVHFlatNode<3>>& flat, uint32_t n) {
+    std::vector<uint32_t> children;
+    if (flat[n].count > 0) {
+        children.push_back(n);
+    }
+    else {
+        children.push_back(n + 1);
+        children.push_back(flat[n].offset);
+    }
+
+    while (children.size() < 4) {
+        int widest = -1;
+        for (size_t i = 0; i < children.size(); i++) {
+            if (flat[children[i]].count > 0) continue;
+            if (widest < 0 || flat[children[i]].bounds.measure() > flat[children[widest]].bounds.measure()) widest = (int)i;
+        }
+        if (widest < 0) break;
+
+        uint32_t c = children[widest];
+        children[widest] = c + 1;
+        children.push_back(flat[c].offset);
+    }
+
+    int32_t node_index = (int32_t)nodes.size();
+    nodes.push_back(BVH4Node());
+    for (int lane = 0; lane < 4; lane++) {
+        for (int a = 0; a < 3; a++) {
+            nodes[node_index].boxes.bounds[0][a][lane] = infinity;
+            nodes[node_index].boxes.bounds[1][a][lane] = -infinity;
+        }
+        nodes[node_index].child[lane] = 0;
+        nodes[node_index].count[lane] = 0;
+    }
+
+    for (size_t lane = 0; lane < children.size(); lane++) {
+        const BVHFlatNode<3>& c = flat[children[lane]];
+        for (int a = 0; a < 3; a++) {
+            nodes[node_index].boxes.bounds[0][a][lane] = float_down(c.bounds.lo[a]);
+            nodes[node_index].boxes.bounds[1][a][lane] = float_up(c.bounds.hi[a]);
+        }
+        if (c.count > 0) {
+            nodes[node_index].child[lane] = ~(int32_t)c.offset;
+            nodes[node_index].count[lane] = (uint16_t)c.count;
+        }
+        else {
+            // nodes may reallocate while the child is built
+            int32_t child = collapse(flat, children[lane]);
+            nodes[node_index].child[lane] = child;
+        }
+    }
+    return node_index;
+}
+
+bool BVH4::bounding_box(double t0, double t1, BoundingBox& output_box) const {
+    if (nodes.empty()) return false;
+    output_box = box;
+    return true;
+}
+
+bool BVH4::hit(const Ray& r, double tmin, double tmax, hit_record& rec) const {
+    if (nodes.empty()) return false;
+
+    double origin[3] = { r.origin().x(), r.origin().y(), r.origin().z() };
+    double dir[3] = { r.direction().x(), r.direction().y(), r.direction().z() };
+    SlabRay slab_ray = prepare_slab_ray(origin, dir);
+
+    bool hit_anything = false;
+    double closest_so_far = tmax;
+    TRACE_STAT(TraceStats& stats = thread_trace_stats());
+    TRACE_STAT(stats.rays++);
+
+    // children waiting to be visited with the distance where the ray enters them.
+    // a node pushes its hit children farthest first, so the nearest is popped next
+    struct Entry {
+        int32_t child;
+        uint32_t count;
+        float t;
+    };
+    Entry stack[256];
+    int stack_size = 0;
+    stack[stack_size++] = { 0, 0, float_down(tmin) };
+
+    while (stack_size > 0) {
+        Entry entry = stack[--stack_size];
+        if (entry.t > closest_so_far) continue;
+        TRACE_STAT(stats.nodes_visited++);
+
+        if (entry.child < 0) {
+            uint32_t first = ~entry.child;
+            TRACE_STAT(stats.primitive_tests += entry.count);
+            for (uint32_t i = first; i < first + entry.count; i++) {
+                if (primitives[i]->hit(r, tmin, closest_so_far, rec)) {
+                    hit_anything = true;
+                    closest_so_far = rec.t;
+                }
+            }
+            continue;
+        }
+
+        const BVH4Node& node = nodes[entry.child];
+        float t_near[4];
+        TRACE_STAT(stats.box_tests += 4);   // one per lane, empty lanes included
+        int mask = slab_test4(node.boxes, slab_ray, float_down(tmin), float_up(closest_so_far), t_near);
+
+        Entry hits[4];
+        int n_hits = 0;
+        for (int lane = 0; lane < 4; lane++) {
+            if (!(mask & (1 << lane))) continue;
+
+            // insertion sort, farthest first
+            Entry e = { node.child[lane], node.count[lane], t_near[lane] };
+            int i = n_hits++;
+            while (i > 0 && hits[i - 1].t < e.t) {
+                hits[i] = hits[i - 1];
+                i--;
+            }
+            hits[i] = e;
+        }
+        for (int i = 0; i < n_hits; i++) {
+            stack[stack_size++] = hits[i];
+        }
+    }
+
+    TRACE_STAT(stats.hits += hit_anything);
+    return hit_anything;
+}
+
+#endif
@@ -0,0 +1,503 @@
+#ifndef BVHBUILD_H
+#define BVHBUILD_H
+
+// BVH construction shared by LinearBVH (Hittable scenes, D = 3) and TetraBVH (4D meshes, D = 4).
+// the builder only sees boxes and centroids and returns the tree in depth first order,
+// each BVH converts that into its own compact node layout.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+// indices of keys in ascending key order, equal keys keep their order.
+// LSD radix sort, 8 bits per pass, linear in the number of keys. the keys travel with the
+// indices so every pass reads sequentially, bytes that are the same in every key are skipped
+inline std::vector<uint32_t> radix_sort_order(const std::vector<uint64_t>& keys) {
+    size_t n = keys.size();
+    std::vector<uint32_t> order(n), order_scratch(n);
+    std::vector<uint64_t> sorted(keys), key_scratch(n);
+    for (size_t i = 0; i < n; i++) order[i] = (uint32_t)i;
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t histogram[257] = {};
+        for (size_t i = 0; i < n; i++) histogram[((sorted[i] >> shift) & 0xFF) + 1]++;
+        if (n == 0 || histogram[((sorted[0] >> shift) & 0xFF) + 1] == n) continue;
+        for (int b = 0; b < 256; b++) histogram[b + 1] += histogram[b];
+        for (size_t i = 0; i < n; i++) {
+            size_t to = histogram[(sorted[i] >> shift) & 0xFF]++;
+            key_scratch[to] = sorted[i];
+            order_scratch[to] = order[i];
+        }
+        sorted.swap(key_scratch);
+        order.swap(order_scratch);
+    }
+    return order;
+}
+
+enum BVHSplitMethod {
+    BVH_SPLIT_MEDIAN,   // centroid median of the widest axis
+    BVH_SPLIT_SAH,      // binned surface area heuristic
+    BVH_SPLIT_MORTON    // LBVH: sort by Morton code, split at the highest differing bit
+};
+
+struct BVHBuildOptions {
+    int max_leaf_size = 4;          // leaves never hold more than this many primitives
+    BVHSplitMethod split = BVH_SPLIT_SAH;
+    int bins = 16;                  // SAH buckets per axis, 2..64
+    double traversal_cost = 1.0;    // relative cost of visiting a node (one box test)
+    double intersection_cost = 2.0; // relative cost of one primitive test
+    int threads = 0;                // 0 uses every core, 1 builds serially
+    size_t parallel_threshold = 4096;   // smaller subtrees and reductions stay on one thread
+};
+
+const int BVH_MAX_BINS = 64;
+
+// expected cost of a node under the SAH cost model, relative to the root:
+// the probability of reaching it (area ratio) times what it costs once reached
+inline double sah_node_cost(double area, double root_area, int n_primitives, const BVHBuildOptions& options) {
+    if (root_area <= 0) return 0.0;
+    double work = (n_primitives > 0) ? n_primitives * options.intersection_cost : options.traversal_cost;
+    return area / root_area * work;
+}
+
+template <int D>
+struct BVHBounds {
+    double lo[D];
+    double hi[D];
+
+    BVHBounds() {
+        for (int a = 0; a < D; a++) {
+            lo[a] = std::numeric_limits<double>::infinity();
+            hi[a] = -std::numeric_limits<double>::infinity();
+        }
+    }
+
+    void grow(const double* p) {
+        for (int a = 0; a < D; a++) {
+            lo[a] = std::min(lo[a], p[a]);
+            hi[a] = std::max(hi[a], p[a]);
+        }
+    }
+
+    void grow(const BVHBounds& b) {
+        for (int a = 0; a < D; a++) {
+            lo[a] = std::min(lo[a], b.lo[a]);
+            hi[a] = std::max(hi[a], b.hi[a]);
+        }
+    }
+
+    bool empty() const { return lo[0] > hi[0]; }
+
+    // size of the boundary: surface area in 3D, sum of the 8 cell volumes in 4D.
+    // proportional to the chance that a random ray crosses the box
+    double measure() const {
+        if (empty()) return 0.0;
+        double sum = 0.0;
+        for (int a = 0; a < D; a++) {
+            double face = 1.0;
+            for (int b = 0; b < D; b++) {
+                if (b != a) face *= hi[b] - lo[b];
+            }
+            sum += face;
+        }
+        return 2.0 * sum;
+    }
+};
+
+template <int D>
+struct BVHBuildPrimitive {
+    BVHBounds<D> box;
+    double centroid[D];
+    uint32_t index;     // position in the caller's primitive list
+    uint32_t group = 0; // leaves never mix groups, e.g. primitive types of a Scene
+};
+
+// node of a finished tree in depth first order: the first child of an interior node is
+// the next node, offset is the second child (interior) or the first primitive (leaf)
+template <int D>
+struct BVHFlatNode {
+    BVHBounds<D> bounds;
+    uint32_t offset;
+    uint32_t count;     // 0 for interior nodes
+    int axis;
+};
+
+template <int D>
+class BVHBuilder {
+public:
+    BVHBuilder(const BVHBuildOptions& build_options);
+
+    // reorders prims so every leaf is a contiguous range of them
+    std::vector<BVHFlatNode<D>> build(std::vector<BVHBuildPrimitive<D>>& prims);
+
+    // SAH cost of a finished tree, to compare builds
+    double expected_cost(const std::vector<BVHFlatNode<D>>& flat) const;
+
+private:
+    struct Node {
+        BVHBounds<D> bounds;
+        uint32_t first;
+        uint32_t count;
+        int axis;
+        uint32_t left;
+        uint32_t right;
+        uint32_t subtree_size;
+    };
+
+    struct Bins {
+        int counts[D][BVH_MAX_BINS];
+        BVHBounds<D> bounds[D][BVH_MAX_BINS];
+    };
+
+    uint32_t build_range(std::vector<BVHBuildPrimitive<D>>& prims, size_t start, size_t end);
+    size_t sah_split(std::vector<BVHBuildPrimitive<D>>& prims, size_t start, size_t end,
+                     const BVHBounds<D>& node_bounds, const BVHBounds<D>& centroid_bounds, int& axis);
+    size_t morton_split(size_t start, size_t end, int& axis) const;
+    size_t group_split(std::vector<BVHBuildPrimitive<D>>& prims, size_t start, size_t end) const;
+    void sort_by_morton(std::vector<BVHBuildPrimitive<D>>& prims);
+
+    bool claim_thread();
+    int reduction_chunks(size_t span) const;
+    template <typename F>
+    void parallel_chunks(size_t start, size_t end, int chunks, F fn);
+
+    BVHBuildOptions options;
+    int max_threads;
+    std::vector<Node> nodes;
+    std::vector<uint64_t> codes;
+    std::atomic<uint32_t> node_count;
+    std::atomic<int> active_threads;
+};
+
+template <int D>
+BVHBuilder<D>::BVHBuilder(const BVHBuildOptions& build_options)
+    : options(build_options), node_count(0), active_threads(1)
+{
+    options.max_leaf_size = std::max(1, std::min(options.max_leaf_size, 65535));
+    options.bins = std::max(2, std::min(options.bins, BVH_MAX_BINS));
+    options.parallel_threshold = std::max<size_t>(options.parallel_threshold, 64);
+    max_threads = options.threads > 0 ? options.threads : std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+// take one more thread for a subtree task if the budget allows
+template <int D>
+bool BVHBuilder<D>::claim_thread() {
+    int active = active_threads.load();
+    while (active < max_threads) {
+        if (active_threads.compare_exchange_weak(active, active + 1)) return true;
+    }
+    return false;
+}
+
+// big ranges near the root are reduced on several threads, those cores are idle there anyway
+template <int D>
+int BVHBuilder<D>::reduction_chunks(size_t span) const {
+    int idle = max_threads - active_threads.load() + 1;
+    int useful = (int)(span / options.parallel_threshold);
+    return std::max(1, std::min(idle, useful));
+}
+
+// runs fn(chunk, chunk_start, chunk_end) for `chunks` equal parts of [start, end)
+template <int D>
+template <typename F>
+void BVHBuilder<D>::parallel_chunks(size_t start, size_t end, int chunks, F fn) {
+    size_t span = end - start;
+    std::vector<std::thread> workers;
+    for (int c = 1; c < chunks; c++) {
+        workers.push_back(std::thread(fn, c, start + span * c / chunks, start + span * (c + 1) / chunks));
+    }
+    fn(0, start, start + span / chunks);
+    for (std::thread& worker : workers) worker.join();
+}
+
+template <int D>
+std::vector<BVHFlatNode<D>> BVHBuilder<D>::build(std::vector<BVHBuildPrimitive<D>>& prims) {
+    std::vector<BVHFlatNode<D>> flat;
+    if (prims.empty()) return flat;
+
+    nodes.resize(2 * prims.size());
+    node_count = 0;
+    active_threads = 1;
+
+    if (options.split == BVH_SPLIT_MORTON) sort_by_morton(prims);
+    uint32_t root = build_range(prims, 0, prims.size());
+
+    // every node knows the size of its subtree, so its depth first position follows from its parent's
+    flat.resize(node_count);
+    std::vector<std::pair<uint32_t, uint32_t>> stack;   // (node, position)
+    stack.push_back(std::make_pair(root, 0u));
+    while (!stack.empty()) {
+        uint32_t n = stack.back().first;
+        uint32_t position = stack.back().second;
+        stack.pop_back();
+
+        const Node& node = nodes[n];
+        BVHFlatNode<D>& out = flat[position];
+        out.bounds = node.bounds;
+        out.count = node.count;
+        out.axis = node.axis;
+        if (node.count > 0) {
+            out.offset = node.first;
+        }
+        else {
+            out.offset = position + 1 + nodes[node.left].subtree_size;
+            stack.push_back(std::make_pair(node.left, position + 1));
+            stack.push_back(std::make_pair(node.right, out.offset));
+        }
+    }
+
+    nodes.clear();
+    nodes.shrink_to_fit();
+    codes.clear();
+    return flat;
+}
+
+template <int D>
+uint32_t BVHBuilder<D>::build_range(std::vector<BVHBuildPrimitive<D>>& prims, size_t start, size_t end) {
+    uint32_t node_index = node_count++;
+    Node& node = nodes[node_index];
+    size_t span = end - start;
+
+    // bounds of the primitives and of their centroids, reduced in parallel near the root
+    int chunks = reduction_chunks(span);
+    std::vector<BVHBounds<D>> chunk_bounds(chunks), chunk_centroids(chunks);
+    parallel_chunks(start, end, chunks, [&](int c, size_t s, size_t e) {
+        for (size_t i = s; i < e; i++) {
+            chunk_bounds[c].grow(prims[i].box);
+            chunk_centroids[c].grow(prims[i].centroid);
+        }
+    });
+    BVHBounds<D> centroid_bounds;
+    for (int c = 0; c < chunks; c++) {
+        node.bounds.grow(chunk_bounds[c]);
+        centroid_bounds.grow(chunk_centroids[c]);
+    }
+
+    node.first = (uint32_t)start;
+    node.count = (uint32_t)span;
+    node.axis = 0;
+    node.subtree_size = 1;
+    if (span == 1) return node_index;
+
+    int axis = 0;
+    for (int a = 1; a < D; a++) {
+        if (centroid_bounds.hi[a] - centroid_bounds.lo[a] > centroid_bounds.hi[axis] - centroid_bounds.lo[axis]) axis = a;
+    }
+
+    size_t mid = start;
+    if (options.split == BVH_SPLIT_SAH) {
+        mid = sah_split(prims, start, end, node.bounds, centroid_bounds, axis);
+    }
+    else if (options.split == BVH_SPLIT_MORTON && (int)span > options.max_leaf_size) {
+        mid = morton_split(start, end, axis);
+    }
+    if (mid == start && (int)span <= options.max_leaf_size) {
+        mid = group_split(prims, start, end);
+        if (mid == start) return node_index;
+    }
+
+    if (mid == start || mid == end) {
+        // nothing separates the centroids here, halve the range to keep leaves small
+        mid = start + span / 2;
+        if (options.split != BVH_SPLIT_MORTON && centroid_bounds.hi[axis] > centroid_bounds.lo[axis]) {
+            std::nth_element(prims.begin() + start, prims.begin() + mid, prims.begin() + end,
+                [axis](const BVHBuildPrimitive<D>& a, const BVHBuildPrimitive<D>& b) { return a.centroid[axis] < b.centroid[axis]; });
+        }
+    }
+
+    node.count = 0;
+    node.axis = axis;
+
+    // fork the left subtree onto another thread when it is big enough and a core is free
+    if (span >= options.parallel_threshold && claim_thread()) {
+        uint32_t left = 0;
+        std::thread task([&]() {
+            left = build_range(prims, start, mid);
+            active_threads--;
+        });
+        uint32_t right = build_range(prims, mid, end);
+        task.join();
+        node.left = left;
+        node.right = right;
+    }
+    else {
+        node.left = build_range(prims, start, mid);
+        node.right = build_range(prims, mid, end);
+    }
+    node.subtree_size = 1 + nodes[node.left].subtree_size + nodes[node.right].subtree_size;
+    return node_index;
+}
+
+// binned SAH, returns the split point, or start when a leaf is cheaper than any split
+template <int D>
+size_t BVHBuilder<D>::sah_split(std::vector<BVHBuildPrimitive<D>>& prims, size_t start, size_t end,
+                                const BVHBounds<D>& node_bounds, const BVHBounds<D>& centroid_bounds, int& axis) {
+    const int n_bins = options.bins;
+    size_t span = end - start;
+
+    double scale[D];
+    for (int a = 0; a < D; a++) {
+        double extent = centroid_bounds.hi[a] - centroid_bounds.lo[a];
+        scale[a] = extent > 0 ? n_bins / extent : 0.0;
+    }
+
+    // every chunk fills its own bins, merged afterwards
+    int chunks = reduction_chunks(span);
+    std::vector<Bins> chunk_bins(chunks);
+    parallel_chunks(start, end, chunks, [&](int c, size_t s, size_t e) {
+        Bins& bins = chunk_bins[c];
+        for (int a = 0; a < D; a++) {
+            std::fill(bins.counts[a], bins.counts[a] + n_bins, 0);
+        }
+        for (size_t i = s; i < e; i++) {
+            for (int a = 0; a < D; a++) {
+                if (scale[a] == 0.0) continue;
+                int b = std::min(n_bins - 1, (int)((prims[i].centroid[a] - centroid_bounds.lo[a]) * scale[a]));
+                bins.counts[a][b]++;
+                bins.bounds[a][b].grow(prims[i].box);
+            }
+        }
+    });
+    Bins& bins = chunk_bins[0];
+    for (int c = 1; c < chunks; c++) {
+        for (int a = 0; a < D; a++) {
+            for (int b = 0; b < n_bins; b++) {
+                bins.counts[a][b] += chunk_bins[c].counts[a][b];
+                bins.bounds[a][b].grow(chunk_bins[c].bounds[a][b]);
+            }
+        }
+    }
+
+    double best_cost = std::numeric_limits<double>::infinity();
+    int best_axis = -1;
+    int best_bin = 0;
+    for (int a = 0; a < D; a++) {
+        if (scale[a] == 0.0) continue;
+
+        // sweep from the right for the area and count right of every plane
+        double right_area[BVH_MAX_BINS];
+        int right_count[BVH_MAX_BINS];
+        BVHBounds<D> right;
+        int count = 0;
+        for (int b = n_bins - 1; b > 0; b--) {
+            right.grow(bins.bounds[a][b]);
+            count += bins.counts[a][b];
+            right_area[b] = right.measure();
+            right_count[b] = count;
+        }
+
+        // plane b lies between bin b-1 and bin b
+        BVHBounds<D> left;
+        count = 0;
+        for (int b = 1; b < n_bins; b++) {
+            left.grow(bins.bounds[a][b - 1]);
+            count += bins.counts[a][b - 1];
+            if (count == 0 || right_count[b] == 0) continue;
+
+            double cost = left.measure() * count + right_area[b] * right_count[b];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = a;
+                best_bin = b;
+            }
+        }
+    }
+
+    if (best_axis < 0) return start;
+
+    double area = node_bounds.measure();
+    double split_cost = options.traversal_cost + (area > 0 ? best_cost / area : 0.0) * options.intersection_cost;
+    double leaf_cost = span * options.intersection_cost;
+    if ((int)span <= options.max_leaf_size && leaf_cost <= split_cost) return start;
+
+    axis = best_axis;
+    double lo = centroid_bounds.lo[axis];
+    double s = scale[axis];
+    auto middle = std::partition(prims.begin() + start, prims.begin() + end,
+        [=](const BVHBuildPrimitive<D>& p) {
+            return std::min(n_bins - 1, (int)((p.centroid[axis] - lo) * s)) < best_bin;
+        });
+    return middle - prims.begin();
+}
+
+// LBVH: bits of the D quantized centroid coordinates interleaved, 64 / D bits per axis
+template <int D>
+void BVHBuilder<D>::sort_by_morton(std::vector<BVHBuildPrimitive<D>>& prims) {
+    const int bits = 64 / D;
+    const double cells = (double)((1ull << bits) - 1);
+    size_t n = prims.size();
+
+    BVHBounds<D> centroid_bounds;
+    for (const BVHBuildPrimitive<D>& p : prims) centroid_bounds.grow(p.centroid);
+
+    std::vector<uint64_t> keys(n);
+    int chunks = reduction_chunks(n);
+    parallel_chunks(0, n, chunks, [&](int /*chunk*/, size_t s, size_t e) {
+        for (size_t i = s; i < e; i++) {
+            uint64_t code = 0;
+            for (int a = 0; a < D; a++) {
+                double extent = centroid_bounds.hi[a] - centroid_bounds.lo[a];
+                double f = extent > 0 ? (prims[i].centroid[a] - centroid_bounds.lo[a]) / extent : 0.0;
+                uint64_t q = (uint64_t)(f * cells);
+                for (int b = 0; b < bits; b++) {
+                    code |= ((q >> b) & 1ull) << (b * D + a);
+                }
+            }
+            keys[i] = code;
+        }
+    });
+
+    std::vector<uint32_t> order = radix_sort_order(keys);
+
+    std::vector<BVHBuildPrimitive<D>> sorted(n);
+    codes.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        sorted[i] = prims[order[i]];
+        codes[i] = keys[order[i]];
+    }
+    prims.swap(sorted);
+}
+
+// first index in [start, end) whose code has the highest differing bit of the range set
+template <int D>
+size_t BVHBuilder<D>::morton_split(size_t start, size_t end, int& axis) const {
+    uint64_t diff = codes[start] ^ codes[end - 1];
+    if (diff == 0) return start;
+
+    int bit = 63;
+    while (!((diff >> bit) & 1ull)) bit--;
+    axis = bit % D;
+
+    size_t lo = start, hi = end - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if ((codes[mid] >> bit) & 1ull) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo;
+}
+
+// splits off the primitives of the first group, start if the range holds only one group
+template <int D>
+size_t BVHBuilder<D>::group_split(std::vector<BVHBuildPrimitive<D>>& prims, size_t start, size_t end) const {
+    uint32_t group = prims[start].group;
+    auto middle = std::partition(prims.begin() + start, prims.begin() + end,
+        [group](const BVHBuildPrimitive<D>& p) { return p.group == group; });
+    size_t mid = middle - prims.begin();
+    return (mid == end) ? start : mid;
+}
+
+template <int D>
+double BVHBuilder<D>::expected_cost(const std::vector<BVHFlatNode<D>>& flat) const {
+    if (flat.empty()) return 0.0;
+    double root_area = flat[0].bounds.measure();
+    double cost = 0.0;
+    for (const BVHFlatNode<D>& node : flat) {
+        cost += sah_node_cost(node.bounds.measure(), root_area, node.count, options);
+    }
+    return cost;
+}
+
+#endif
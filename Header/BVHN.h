@@ -0,0 +1,185 @@
+#ifndef BVHN_H
+#define BVHN_H
+
+// BVH over D dimensional boxes, written once for LinearBVH (D = 3) and TetraBVH (D = 4).
+// the tree is built by BVHBuilder<D> and flattened in depth first order: the first child is
+// the next node, interior nodes store the index of the second child.
+// a node keeps its bounds in D floats per side: 32 bytes for D = 3, 40 for D = 4, and one box
+// test is one slab_test_3d or slab_test_4d.
+// the primitives are whatever the owner makes of the indices, it tests a leaf's range in a
+// callback.
+
+#include "BVHBuild.h"
+#include "SlabTest.h"
+#include "TraceStats.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// round outwards when narrowing to float, so the float box still contains the double box
+inline float float_down(double x) {
+    float f = (float)x;
+    return (f > x) ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+}
+
+inline float float_up(double x) {
+    float f = (float)x;
+    return (f < x) ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+}
+
+template <int D>
+struct BVHNodeN {
+    float lo[D];
+    float hi[D];        // slab_test_3d reads one float past hi[2], that is offset
+    uint32_t offset;    // first entry in BVHN::prims (leaf) or second child (interior)
+    uint16_t count;     // number of primitives, 0 for interior nodes
+    uint8_t axis;       // split axis of interior nodes
+    uint8_t pad;
+};
+
+static_assert(sizeof(BVHNodeN<3>) == 32, "3D nodes are 32 bytes, two to a cache line");
+static_assert(sizeof(BVHNodeN<4>) == 40, "4D nodes are 40 bytes, TetraFile stores them as they are");
+
+// box test of a node, the ray lanes past D are ignored
+inline bool slab_test_node(const BVHNodeN<3>& node, const SlabRay4D& ray, float tmin, float tmax, float& t_near) {
+    return slab_test_3d(node.lo, node.hi, ray, tmin, tmax, t_near);
+}
+
+inline bool slab_test_node(const BVHNodeN<4>& node, const SlabRay4D& ray, float tmin, float tmax, float& t_near) {
+    return slab_test_4d(node.lo, node.hi, ray, tmin, tmax, t_near);
+}
+
+template <int D>
+class BVHN {
+    static_assert(D == 3 || D == 4, "the bounds of a BVHN node fill one four lane register");
+
+public:
+    BVHN() {}
+    // reorders prims, prims[i].index is the primitive of BVHN::prims[i] afterwards
+    BVHN(std::vector<BVHBuildPrimitive<D>>& primitives, const BVHBuildOptions& build_options = BVHBuildOptions());
+
+    // visits every leaf whose box the ray enters within [tmin, tmax], near child first.
+    // leaf(const uint32_t* prims, int count, float tmin, float& tmax) tests a leaf's range and
+    // returns whether it hit something; it may lower tmax to cull farther boxes. the leaf
+    // counts its own primitive_tests, it knows how many it tested before stopping.
+    // any-hit queries (see HitQuery.h) stop at the first leaf that reports a hit
+    template <typename Query, typename LeafTest>
+    bool traverse(const float origin[D], const float dir[D], float tmin, float tmax, LeafTest&& leaf) const;
+
+    // box of the whole tree, false when it is empty
+    bool bounds(double lo[D], double hi[D]) const;
+
+    size_t node_count() const { return nodes.size(); }
+
+    // SAH cost of the finished tree, to compare builds
+    double expected_cost() const { return sah_cost; }
+
+public:
+    std::vector<BVHNodeN<D>> nodes;
+    std::vector<uint32_t> prims;    // primitive indices, every leaf is a contiguous range
+    BVHBuildOptions options;
+    double sah_cost = 0.0;
+};
+
+template <int D>
+BVHN<D>::BVHN(std::vector<BVHBuildPrimitive<D>>& primitives, const BVHBuildOptions& build_options)
+    : options(build_options)
+{
+    if (primitives.empty()) return;
+
+    BVHBuilder<D> builder(options);
+    std::vector<BVHFlatNode<D>> flat = builder.build(primitives);
+    sah_cost = builder.expected_cost(flat);
+
+    nodes.resize(flat.size());
+    for (size_t n = 0; n < flat.size(); n++) {
+        for (int a = 0; a < D; a++) {
+            nodes[n].lo[a] = float_down(flat[n].bounds.lo[a]);
+            nodes[n].hi[a] = float_up(flat[n].bounds.hi[a]);
+        }
+        nodes[n].offset = flat[n].offset;
+        nodes[n].count = (uint16_t)flat[n].count;
+        nodes[n].axis = (uint8_t)flat[n].axis;
+        nodes[n].pad = 0;
+    }
+
+    prims.resize(primitives.size());
+    for (size_t i = 0; i < primitives.size(); i++) {
+        prims[i] = primitives[i].index;
+    }
+}
+
+template <int D>
+bool BVHN<D>::bounds(double lo[D], double hi[D]) const {
+    if (nodes.empty()) return false;
+    for (int a = 0; a < D; a++) {
+        lo[a] = nodes[0].lo[a];
+        hi[a] = nodes[0].hi[a];
+    }
+    return true;
+}
+
+template <int D>
+template <typename Query, typename LeafTest>
+bool BVHN<D>::traverse(const float origin[D], const float dir[D], float tmin, float tmax, LeafTest&& leaf) const {
+    if (nodes.empty()) return false;
+    TRACE_STAT(TraceStats& stats = thread_trace_stats());
+    TRACE_STAT(stats.rays++);
+
+    // the fourth lane of a 3D ray is never looked at, 0 with direction 1 keeps it finite
+    float o[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float d[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int a = 0; a < D; a++) {
+        o[a] = origin[a];
+        d[a] = dir[a];
+    }
+    SlabRay4D slab_ray = prepare_slab_ray_4d(o, d);
+    const int* dir_is_neg = slab_ray.sign;
+
+    bool hit_anything = false;
+
+    // nodes still to visit, the far child waits here while the near child is traversed
+    uint32_t stack[64];
+    int stack_size = 0;
+    uint32_t current = 0;
+
+    while (true) {
+        const BVHNodeN<D>& node = nodes[current];
+
+        float t_near;
+        TRACE_STAT(stats.box_tests++);
+        if (slab_test_node(node, slab_ray, tmin, tmax, t_near)) {
+            TRACE_STAT(stats.nodes_visited++);
+            if (node.count > 0) {
+                if (leaf(&prims[node.offset], (int)node.count, tmin, tmax)) {
+                    hit_anything = true;
+                    if (Query::any_hit) {
+                        TRACE_STAT(stats.hits++);
+                        return true;
+                    }
+                }
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+            else if (dir_is_neg[node.axis]) {
+                stack[stack_size++] = current + 1;
+                current = node.offset;
+            }
+            else {
+                stack[stack_size++] = node.offset;
+                current = current + 1;
+            }
+        }
+        else {
+            if (stack_size == 0) break;
+            current = stack[--stack_size];
+        }
+    }
+
+    TRACE_STAT(stats.hits += hit_anything);
+    return hit_anything;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef BOUNDINGBOX4_H
+#define BOUNDINGBOX4_H
+
+#include "Renderer.h"
+#include "vec4.h"
+#include "Ray4.h"
+#include "AABB.h"
+
+using RayPrep4 = RayPrepN<4, double>;
+using BoundingBox4 = AABB<4, double>;
+
+#endif
@@ -9,7 +9,7 @@
 class Box : public Hittable  {
     public:
         Box() {}
-        Box(const Point3& p0, const Point3& p1, shared_ptr<Material> ptr);
+        Box(const Point3& p0, const Point3& p1, uint32_t material_id);
 
         virtual bool hit(const Ray& r, double t0, double t1, hit_record& rec) const override;
 
@@ -24,18 +24,18 @@ class Box : public Hittable  {
         Hittable_List sides;
 };
 
-Box::Box(const Point3& p0, const Point3& p1, shared_ptr<Material> ptr) {
+Box::Box(const Point3& p0, const Point3& p1, uint32_t material_id) {
     Box_min = p0;
     Box_max = p1;
 
-    sides.add(make_shared<XY_Rectangle>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), ptr));
-    sides.add(make_shared<XY_Rectangle>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), ptr));
+    sides.add(make_shared<XY_Rectangle>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), material_id));
+    sides.add(make_shared<XY_Rectangle>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), material_id));
 
-    sides.add(make_shared<XZ_Rectangle>(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), ptr));
-    sides.add(make_shared<XZ_Rectangle>(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), ptr));
+    sides.add(make_shared<XZ_Rectangle>(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), material_id));
+    sides.add(make_shared<XZ_Rectangle>(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), material_id));
 
-    sides.add(make_shared<YZ_Rectangle>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), ptr));
-    sides.add(make_shared<YZ_Rectangle>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), ptr));
+    sides.add(make_shared<YZ_Rectangle>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), material_id));
+    sides.add(make_shared<YZ_Rectangle>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), material_id));
 }
 
 bool Box::hit(const Ray& r, double t0, double t1, hit_record& rec) const {
@@ -3,13 +3,15 @@
 
 #include "Renderer.h"
 
-class Camera {
+// pinhole camera over the scalar type T, the rays it makes are Ray_t<T>
+template <typename T>
+class Camera_t {
     public:
-        Camera(Point3 lookfrom, Point3 lookat, vec3 vup, double vfov = 2.0, double aspect_ratio = 16.0/9.0){
+        Camera_t(vec3_t<T> lookfrom, vec3_t<T> lookat, vec3_t<T> vup, double vfov = 2.0, double aspect_ratio = 16.0/9.0){
             auto theta = degrees_to_radians(vfov);
-            auto h = tan(theta/2);
-            auto viewport_height = 2.0 * h;
-            auto viewport_width = aspect_ratio * viewport_height;
+            T h = (T)tan(theta/2);
+            T viewport_height = 2 * h;
+            T viewport_width = (T)aspect_ratio * viewport_height;
             
             auto w = unit_vector(lookfrom-lookat);
             auto u = unit_vector(cross(vup, w));
@@ -30,14 +32,18 @@ class Camera {
             */
         }
 
-        Ray get_ray(double u, double v) const {
-            return Ray(origin, lower_left_corner + u*horizontal + v*vertical - origin);
+        Ray_t<T> get_ray(double u, double v) const {
+            return Ray_t<T>(origin, lower_left_corner + (T)u*horizontal + (T)v*vertical - origin);
         }
 
     private:
-        Point3 origin;
-        Point3 lower_left_corner;
-        vec3 horizontal;
-        vec3 vertical;
+        vec3_t<T> origin;
+        vec3_t<T> lower_left_corner;
+        vec3_t<T> horizontal;
+        vec3_t<T> vertical;
 };
+
+using Camera = Camera_t<double>;
+using Cameraf = Camera_t<float>;
+
 #endif
\ No newline at end of file
@@ -4,13 +4,15 @@
 #include "Ray4.h"
 #include "Renderer.h"
 
-class Camera4 {
+// 4D pinhole camera over the scalar type T, like Camera_t
+template <typename T>
+class Camera4_t {
 public:
-    Camera4(Point4 lookfrom, Point4 lookat, vec4 vup, vec4 vov, double vfov = 2.0, double aspect_ratio = 16.0 / 9.0) {
+    Camera4_t(vec4_t<T> lookfrom, vec4_t<T> lookat, vec4_t<T> vup, vec4_t<T> vov, double vfov = 2.0, double aspect_ratio = 16.0 / 9.0) {
         auto theta = degrees_to_radians(vfov);
-        auto h = tan(theta / 2);
-        auto viewport_height = 2.0 * h;
-        auto viewport_width = aspect_ratio * viewport_height;
+        T h = (T)tan(theta / 2);
+        T viewport_height = 2 * h;
+        T viewport_width = (T)aspect_ratio * viewport_height;
 
         auto w = unit_vector(lookfrom - lookat);
         auto u = unit_vector(cross(vup, w, vov));
@@ -24,15 +26,19 @@ public:
         lower_left_corner = origin - horizontal / 2 - vertical / 2 - w;
     }
 
-    Ray4 get_ray(double u, double v) const {
-        return Ray4(origin, lower_left_corner + u * horizontal + v * vertical - origin);
+    Ray4_t<T> get_ray(double u, double v) const {
+        return Ray4_t<T>(origin, lower_left_corner + (T)u * horizontal + (T)v * vertical - origin);
     }
 
 private:
-    Point4 origin;
-    Point4 lower_left_corner;
-    vec4 horizontal;
-    vec4 vertical;
-    vec4 over;
+    vec4_t<T> origin;
+    vec4_t<T> lower_left_corner;
+    vec4_t<T> horizontal;
+    vec4_t<T> vertical;
+    vec4_t<T> over;
 };
+
+using Camera4 = Camera4_t<double>;
+using Camera4f = Camera4_t<float>;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,119 @@
+#ifndef DET4_H
+#define DET4_H
+
+// 4x4 determinants built from 2x2 minors. the Cramer solve of a ray-tetrahedron test needs
+// five determinants that share three of their four rows, so the minors of the shared rows
+// are computed once and every determinant is a few more products on top of them.
+// everything is templated on the value type V: float or double for one system, Lanes4f for
+// four systems side by side.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DET4_SSE
+#include <emmintrin.h>
+#endif
+
+// 2x2 minors of the rows a and b, m[ij] = a[i] b[j] - a[j] b[i] in the order 01 02 03 12 13 23
+template <typename V>
+inline void minors4(const V a[4], const V b[4], V m[6]) {
+    m[0] = a[0] * b[1] - a[1] * b[0];
+    m[1] = a[0] * b[2] - a[2] * b[0];
+    m[2] = a[0] * b[3] - a[3] * b[0];
+    m[3] = a[1] * b[2] - a[2] * b[1];
+    m[4] = a[1] * b[3] - a[3] * b[1];
+    m[5] = a[2] * b[3] - a[3] * b[2];
+}
+
+// det(a, b, c, d) from the minors of (a, b) and (c, d), Laplace expansion along two rows
+template <typename V>
+inline V det4_minors(const V ab[6], const V cd[6]) {
+    return ab[0] * cd[5] - ab[1] * cd[4] + ab[2] * cd[3] + ab[3] * cd[2] - ab[4] * cd[1] + ab[5] * cd[0];
+}
+
+// n with dot(x, n) = det(x, b, c, d), cd = minors4(c, d)
+template <typename V>
+inline void det4_first_row(const V b[4], const V cd[6], V n[4]) {
+    n[0] = b[1] * cd[5] - b[2] * cd[4] + b[3] * cd[3];
+    n[1] = b[2] * cd[2] - b[0] * cd[5] - b[3] * cd[1];
+    n[2] = b[0] * cd[4] - b[1] * cd[2] + b[3] * cd[0];
+    n[3] = b[1] * cd[1] - b[0] * cd[3] - b[2] * cd[0];
+}
+
+// g with dot(g, d) = det(a, b, c, d), ab = minors4(a, b)
+template <typename V>
+inline void det4_last_row(const V ab[6], const V c[4], V g[4]) {
+    g[0] = ab[4] * c[2] - ab[3] * c[3] - ab[5] * c[1];
+    g[1] = ab[1] * c[3] - ab[2] * c[2] + ab[5] * c[0];
+    g[2] = ab[2] * c[1] - ab[0] * c[3] - ab[4] * c[0];
+    g[3] = ab[0] * c[2] - ab[1] * c[1] + ab[3] * c[0];
+}
+
+template <typename V>
+inline V dot4(const V a[4], const V b[4]) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+}
+
+template <typename V>
+inline V det4(const V a[4], const V b[4], const V c[4], const V d[4]) {
+    V ab[6], cd[6];
+    minors4(a, b, ab);
+    minors4(c, d, cd);
+    return det4_minors(ab, cd);
+}
+
+// Cramer's rule for origin + t*dir = v0 + y*e1 + z*e2 + w*e3, with T = origin - v0.
+// returns det(dir, e1, e2, e3), num gets the numerators {-t, y, z, w} * det:
+//   det(T, e1, e2, e3), det(dir, T, e2, e3), det(dir, e1, T, e3), det(dir, e1, e2, T)
+// the minors of (e2, e3) and (dir, T) are shared, about 70 products instead of 5 x 52
+template <typename V>
+inline V ray_tetra_cramer(const V dir[4], const V e1[4], const V e2[4], const V e3[4], const V T[4], V num[4]) {
+    V e23[6], dT[6], n[4], g[4];
+    minors4(e2, e3, e23);
+    minors4(dir, T, dT);
+
+    det4_first_row(e1, e23, n);
+    V det = dot4(dir, n);
+    num[0] = dot4(T, n);
+    num[1] = det4_minors(dT, e23);
+
+    // det(dir, e1, T, e3) = -det(dir, T, e1, e3), det(dir, e1, e2, T) = det(dir, T, e1, e2)
+    det4_last_row(dT, e1, g);
+    num[2] = -dot4(g, e3);
+    num[3] = dot4(g, e2);
+    return det;
+}
+
+// four floats for the batch solve, one system per lane
+struct Lanes4f {
+#ifdef DET4_SSE
+    __m128 v;
+
+    Lanes4f() {}
+    Lanes4f(__m128 x) : v(x) {}
+    explicit Lanes4f(float x) : v(_mm_set1_ps(x)) {}
+
+    static Lanes4f load(const float* p) { return Lanes4f(_mm_loadu_ps(p)); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+#else
+    float v[4];
+
+    Lanes4f() {}
+    explicit Lanes4f(float x) : v{ x, x, x, x } {}
+
+    static Lanes4f load(const float* p) { Lanes4f r; for (int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+    void store(float* p) const { for (int i = 0; i < 4; i++) p[i] = v[i]; }
+#endif
+};
+
+#ifdef DET4_SSE
+inline Lanes4f operator+(Lanes4f a, Lanes4f b) { return _mm_add_ps(a.v, b.v); }
+inline Lanes4f operator-(Lanes4f a, Lanes4f b) { return _mm_sub_ps(a.v, b.v); }
+inline Lanes4f operator*(Lanes4f a, Lanes4f b) { return _mm_mul_ps(a.v, b.v); }
+inline Lanes4f operator-(Lanes4f a) { return _mm_sub_ps(_mm_setzero_ps(), a.v); }
+#else
+inline Lanes4f operator+(Lanes4f a, Lanes4f b) { Lanes4f r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] + b.v[i]; return r; }
+inline Lanes4f operator-(Lanes4f a, Lanes4f b) { Lanes4f r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] - b.v[i]; return r; }
+inline Lanes4f operator*(Lanes4f a, Lanes4f b) { Lanes4f r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] * b.v[i]; return r; }
+inline Lanes4f operator-(Lanes4f a) { Lanes4f r; for (int i = 0; i < 4; i++) r.v[i] = -a.v[i]; return r; }
+#endif
+
+#endif
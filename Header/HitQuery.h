@@ -0,0 +1,27 @@
+#ifndef HITQUERY_H
+#define HITQUERY_H
+
+// compile time options of a ray query. the triangle and tetrahedron tests and the loops over
+// meshes and BVHs take one of these as a template parameter, so every call site gets its own
+// instantiation without the work it does not need and without runtime flags.
+//   any_hit         stop at the first hit instead of looking for the closest one
+//   barycentrics    write the barycentric coordinates of the hit
+//   cull_backfaces  ignore primitives whose determinant is negative (seen from behind)
+//   clip_interval   only accept hits with tmin <= t <= tmax
+template <bool AnyHit, bool Barycentrics, bool CullBackfaces, bool ClipInterval>
+struct HitQuery {
+    static const bool any_hit = AnyHit;
+    static const bool barycentrics = Barycentrics;
+    static const bool cull_backfaces = CullBackfaces;
+    static const bool clip_interval = ClipInterval;
+};
+
+// nearest hit with its barycentrics, what Hittable::hit needs
+typedef HitQuery<false, true, false, true> ClosestHitQuery;
+
+// queries of the 4D renderer
+typedef HitQuery<true, false, false, true> OcclusionQuery;     // AO: anything in front of the vertex
+typedef HitQuery<true, false, false, false> CoverageQuery;     // voxel coverage: anything on the line
+typedef HitQuery<false, false, false, true> ShadingQuery;      // nearest tetrahedron, for its AO values
+
+#endif
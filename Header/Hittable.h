@@ -5,12 +5,32 @@
 #include "ray.h"
 #include "BoundingBox.h"
 
+#include <cstdint>
+#include <type_traits>
+
 class Material;
 
+// materials of a scene. primitives and hit records keep a 32 bit index into the table,
+// so copying a hit never touches a shared_ptr reference count
+class MaterialTable {
+    public:
+        uint32_t add(shared_ptr<Material> material) {
+            materials.push_back(material);
+            return (uint32_t)(materials.size() - 1);
+        }
+
+        const Material& operator[](uint32_t id) const { return *materials[id]; }
+
+        size_t size() const { return materials.size(); }
+
+    public:
+        std::vector<shared_ptr<Material>> materials;
+};
+
 struct hit_record {
     Point3 p;
     vec3 normal;
-    shared_ptr<Material> material_ptr;
+    uint32_t material_id;
     double t;
     double u;
     double v;
@@ -22,6 +42,8 @@ struct hit_record {
     }
 };
 
+static_assert(std::is_trivially_copyable<hit_record>::value, "hit_record is copied for every closer hit");
+
 class Hittable {
     public:
         virtual bool hit(const Ray& r,
@@ -7,12 +7,14 @@
 #include "Ray4.h"
 #include "vec4.h"
 
+#include <cstdint>
+
 class Material;
 
 struct hit_record4 {
     Point4 p;
     vec4 normal;
-    shared_ptr<Material> material_ptr;
+    uint32_t material_id;   // index into the scene's MaterialTable
     double t;
     double u;
     double v;
@@ -24,6 +24,7 @@ class Hittable_List : public Hittable {
         virtual bool bounding_box(double t0, double t1, BoundingBox& output_box) const override;
 
         std::vector<shared_ptr<Hittable>> objects;
+        MaterialTable materials;    // the scene's materials, objects refer to them by id
 };
 
 bool Hittable_List::hit(const Ray& r, double t_min, double t_max, hit_record& rec) const {
@@ -0,0 +1,157 @@
+#ifndef INDEXEDMESH_H
+#define INDEXEDMESH_H
+
+#include "Renderer.h"
+#include "Hittable.h"
+#include "LinearBVH.h"
+#include "TraceStats.h"
+
+#include <cstdint>
+
+// triangle mesh over one shared vertex buffer. a triangle is three uint32 indices (12 bytes),
+// optionally plus its two Moller-Trumbore edges (48 bytes) so a hit does not recompute them.
+// the mesh has its own BVH and returns the nearest hit, unlike Mesh.
+class IndexedMesh : public Hittable {
+    public:
+        IndexedMesh() {}
+        IndexedMesh(const std::vector<Point3>& verts, const std::vector<uint32_t>& tri_indices, uint32_t material)
+            : vertices(verts), indices(tri_indices), material_id(material) {}
+
+        // builds the BVH and reorders the triangles into leaf order, call after filling the buffers.
+        // precompute_edges trades 48 bytes per triangle for two vector subtractions per test
+        void build(bool precompute_edges = true, const BVHBuildOptions& build_options = BVHBuildOptions());
+
+        virtual bool hit(const Ray& r, double tmin, double tmax, hit_record& rec) const override;
+
+        virtual bool bounding_box(double t0, double t1, BoundingBox& output_box) const override;
+
+        size_t triangle_count() const { return indices.size() / 3; }
+
+        size_t node_count() const { return bvh.node_count(); }
+
+        uint32_t triangle_material(uint32_t tri) const {
+            return face_materials.empty() ? material_id : face_materials[tri];
+        }
+
+    private:
+        struct TriangleEdges {
+            vec3 e1;
+            vec3 e2;
+        };
+
+        bool hit_triangle(uint32_t tri, const Ray& r, double tmin, double tmax, hit_record& rec) const;
+
+    public:
+        std::vector<Point3> vertices;
+        std::vector<uint32_t> indices;          // three per triangle
+        std::vector<uint32_t> face_materials;   // per triangle ids, empty if the whole mesh uses material_id
+        uint32_t material_id = 0;
+
+        std::vector<TriangleEdges> edges;       // per triangle, empty without precompute_edges
+        BVHN<3> bvh;                            // triangles are in leaf order, bvh.prims[i] == i
+};
+
+void IndexedMesh::build(bool precompute_edges, const BVHBuildOptions& build_options) {
+    bvh = BVHN<3>();
+    edges.clear();
+
+    size_t n = triangle_count();
+    if (n == 0) return;
+
+    std::vector<BVHBuildPrimitive<3>> prims(n);
+    for (size_t i = 0; i < n; i++) {
+        for (int j = 0; j < 3; j++) {
+            const Point3& v = vertices[indices[3 * i + j]];
+            double p[3] = { v.x(), v.y(), v.z() };
+            prims[i].box.grow(p);
+        }
+        for (int a = 0; a < 3; a++) {
+            prims[i].centroid[a] = 0.5 * (prims[i].box.lo[a] + prims[i].box.hi[a]);
+        }
+        prims[i].index = (uint32_t)i;
+    }
+
+    bvh = BVHN<3>(prims, build_options);
+
+    // triangles in leaf order, a leaf reads one contiguous run of indices
+    std::vector<uint32_t> sorted_indices(indices.size());
+    std::vector<uint32_t> sorted_materials(face_materials.empty() ? 0 : n);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t tri = prims[i].index;
+        for (int j = 0; j < 3; j++) {
+            sorted_indices[3 * i + j] = indices[3 * tri + j];
+        }
+        if (!face_materials.empty()) sorted_materials[i] = face_materials[tri];
+        bvh.prims[i] = (uint32_t)i;
+    }
+    indices.swap(sorted_indices);
+    face_materials.swap(sorted_materials);
+
+    if (precompute_edges) {
+        edges.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            const Point3& v0 = vertices[indices[3 * i]];
+            edges[i].e1 = vertices[indices[3 * i + 1]] - v0;
+            edges[i].e2 = vertices[indices[3 * i + 2]] - v0;
+        }
+    }
+}
+
+bool IndexedMesh::bounding_box(double t0, double t1, BoundingBox& output_box) const {
+    double lo[3], hi[3];
+    if (!bvh.bounds(lo, hi)) return false;
+    output_box = BoundingBox(Point3(lo[0], lo[1], lo[2]), Point3(hi[0], hi[1], hi[2]));
+    return true;
+}
+
+bool IndexedMesh::hit_triangle(uint32_t tri, const Ray& r, double tmin, double tmax, hit_record& rec) const {
+    const Point3& v0 = vertices[indices[3 * tri]];
+    vec3 e1, e2;
+    if (!edges.empty()) {
+        e1 = edges[tri].e1;
+        e2 = edges[tri].e2;
+    }
+    else {
+        e1 = vertices[indices[3 * tri + 1]] - v0;
+        e2 = vertices[indices[3 * tri + 2]] - v0;
+    }
+
+    double t, u, v;
+    if (!intersect_triangle(v0, e1, e2, r, tmin, tmax, t, u, v))
+        return false;
+
+    rec.t = t;
+    rec.u = u;
+    rec.v = v;
+    rec.p = r.at(t);
+    rec.set_face_normal(r, unit_vector(cross(e1, e2)));
+    rec.material_id = triangle_material(tri);
+    return true;
+}
+
+bool IndexedMesh::hit(const Ray& r, double tmin, double tmax, hit_record& rec) const {
+    float origin[3], dir[3];
+    for (int a = 0; a < 3; a++) {
+        origin[a] = (float)r.origin()[a];
+        dir[a] = (float)r.direction()[a];
+    }
+
+    // the boxes are tested in float like LinearBVH, the triangles keep the double interval
+    double closest_so_far = tmax;
+    TRACE_STAT(TraceStats& stats = thread_trace_stats());
+    return bvh.traverse<ClosestHitQuery>(origin, dir, float_down(tmin), float_up(tmax),
+        [&](const uint32_t* tris, int count, float, float& box_tmax) {
+            TRACE_STAT(stats.primitive_tests += count);
+            bool leaf_hit = false;
+            for (int i = 0; i < count; i++) {
+                if (hit_triangle(tris[i], r, tmin, closest_so_far, rec)) {
+                    leaf_hit = true;
+                    closest_so_far = rec.t;
+                    box_tmax = float_up(closest_so_far);
+                }
+            }
+            return leaf_hit;
+        });
+}
+
+#endif
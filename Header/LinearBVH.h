@@ -0,0 +1,89 @@
+#ifndef LINEARBVH_H
+#define LINEARBVH_H
+
+#include "Renderer.h"
+#include "Hittable.h"
+#include "Hittable_List.h"
+#include "BVHN.h"
+#include "HitQuery.h"
+
+#include <algorithm>
+#include <cstdint>
+
+// BVH over a list of Hittables, the 3D instance of BVHN
+class LinearBVH : public Hittable {
+    public:
+        LinearBVH() {}
+        LinearBVH(const Hittable_List& list, const BVHBuildOptions& build_options = BVHBuildOptions())
+            : LinearBVH(list.objects, build_options)
+        {}
+        LinearBVH(const std::vector<shared_ptr<Hittable>>& objects, const BVHBuildOptions& build_options = BVHBuildOptions());
+
+        virtual bool hit(const Ray& r, double tmin, double tmax, hit_record& rec) const override;
+
+        virtual bool bounding_box(double t0, double t1, BoundingBox& output_box) const override;
+
+        size_t node_count() const { return bvh.node_count(); }
+
+        // SAH cost of the finished tree, to compare builds
+        double expected_cost() const { return bvh.expected_cost(); }
+
+    public:
+        BVHN<3> bvh;    // bvh.prims index primitives
+        std::vector<shared_ptr<Hittable>> primitives;
+};
+
+LinearBVH::LinearBVH(const std::vector<shared_ptr<Hittable>>& objects, const BVHBuildOptions& build_options)
+    : primitives(objects)
+{
+    if (objects.empty()) return;
+
+    std::vector<BVHBuildPrimitive<3>> prims(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        BoundingBox box;
+        if (!objects[i]->bounding_box(0, 0, box))
+            std::cerr << "No bounding box in LinearBVH constructor.\n";
+        for (int a = 0; a < 3; a++) {
+            prims[i].box.lo[a] = box.min()[a];
+            prims[i].box.hi[a] = box.max()[a];
+            prims[i].centroid[a] = 0.5 * (box.min()[a] + box.max()[a]);
+        }
+        prims[i].index = (uint32_t)i;
+    }
+
+    bvh = BVHN<3>(prims, build_options);
+}
+
+bool LinearBVH::bounding_box(double t0, double t1, BoundingBox& output_box) const {
+    double lo[3], hi[3];
+    if (!bvh.bounds(lo, hi)) return false;
+    output_box = BoundingBox(Point3(lo[0], lo[1], lo[2]), Point3(hi[0], hi[1], hi[2]));
+    return true;
+}
+
+bool LinearBVH::hit(const Ray& r, double tmin, double tmax, hit_record& rec) const {
+    float origin[3], dir[3];
+    for (int a = 0; a < 3; a++) {
+        origin[a] = (float)r.origin()[a];
+        dir[a] = (float)r.direction()[a];
+    }
+
+    // the boxes are tested in float, the primitives keep the double interval
+    double closest_so_far = tmax;
+    TRACE_STAT(TraceStats& stats = thread_trace_stats());
+    return bvh.traverse<ClosestHitQuery>(origin, dir, float_down(tmin), float_up(tmax),
+        [&](const uint32_t* prims, int count, float, float& box_tmax) {
+            TRACE_STAT(stats.primitive_tests += count);
+            bool leaf_hit = false;
+            for (int i = 0; i < count; i++) {
+                if (primitives[prims[i]]->hit(r, tmin, closest_so_far, rec)) {
+                    leaf_hit = true;
+                    closest_so_far = rec.t;
+                    box_tmax = float_up(closest_so_far);
+                }
+            }
+            return leaf_hit;
+        });
+}
+
+#endif
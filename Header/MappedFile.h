@@ -0,0 +1,118 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+// read only memory mapping of a whole file. loaders use the bytes in place instead of
+// reading them through a stream. the mapping starts on a page boundary, so data the writer
+// aligned within the file keeps that alignment in memory.
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class MappedFile {
+public:
+    MappedFile() {}
+    explicit MappedFile(const std::string& filename) { open(filename); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // maps the file, false (with a message) when it cannot be opened. an empty file maps
+    // to data() == nullptr and size() == 0
+    bool open(const std::string& filename);
+    void close();
+
+    bool is_open() const { return opened; }
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+    bool opened = false;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#else
+    int fd = -1;
+#endif
+};
+
+bool MappedFile::open(const std::string& filename) {
+    close();
+#ifdef _WIN32
+    file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Cannot open " << filename << "\n";
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(file, &file_size);
+    length = (size_t)file_size.QuadPart;
+    if (length > 0) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        bytes = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!bytes) {
+            std::cerr << "Cannot map " << filename << "\n";
+            close();
+            return false;
+        }
+    }
+#else
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Cannot open " << filename << "\n";
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    length = (size_t)st.st_size;
+    if (length > 0) {
+        void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            std::cerr << "Cannot map " << filename << "\n";
+            close();
+            return false;
+        }
+        bytes = (const char*)p;
+    }
+#endif
+    opened = true;
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (bytes) UnmapViewOfFile(bytes);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (bytes) munmap((void*)bytes, length);
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+#endif
+    bytes = nullptr;
+    length = 0;
+    opened = false;
+}
+
+#endif
@@ -22,12 +22,11 @@ bool Mesh::hit(const Ray& r, double tmin, double tmax, hit_record& rec) const {
     bool hit_anything = false;
     auto closest_so_far = tmax;
 
-    for (Triangle t : triangles) {
-        if (t.hit(r, tmin, tmax, temp)) {
+    for (const Triangle& t : triangles) {
+        if (t.hit(r, tmin, closest_so_far, temp)) {
             hit_anything = true;
             closest_so_far = temp.t;
             rec = temp;
-            break;
         }
     }
     return hit_anything;
@@ -39,11 +38,12 @@ bool Mesh::bounding_box(double t0, double t1, BoundingBox& output_box) const {
     }
     BoundingBox temp_box;
     bool first_box = true;
-    for (Triangle t: triangles) {
-        if (t.bounding_box(t0, t1, temp_box)) return false;
+    for (const Triangle& t: triangles) {
+        if (!t.bounding_box(t0, t1, temp_box)) return false;
         output_box = first_box ? temp_box : surrounding_box(output_box, temp_box);
         first_box = false;
     }
+    return true;
 }
 
 void Mesh::AddTriangle(Triangle& t) {
@@ -0,0 +1,584 @@
+#ifndef MESHIMPORT_H
+#define MESHIMPORT_H
+
+// OBJ and binary PLY triangle meshes straight into an IndexedMesh (call build() afterwards).
+// the files are mapped and decoded by several threads into flat arrays, nothing is allocated
+// per triangle. polygons are split into fans. with MeshImportOptions::weld, vertices with the
+// same position are merged through a hash table, so scans and files without shared vertices
+// come out indexed.
+// materials: OBJ usemtl names get ids in order of appearance starting at
+// MeshImportOptions::material_id, faces before the first usemtl use that id too. a PLY face
+// property material_index (or material) is added to material_id, a negative one is an error.
+// a mesh with one material leaves face_materials empty.
+
+#include "Renderer.h"
+#include "IndexedMesh.h"
+#include "MappedFile.h"
+#include "TextScan.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+struct MeshImportOptions {
+    int threads = 0;            // 0 uses every core
+    bool weld = true;           // merge equal positions, triangles that collapse are dropped
+    uint32_t material_id = 0;   // id of the first material
+};
+
+// merges vertices with equal positions (-0 and 0 count as equal) through an open addressing
+// hash table, then drops the triangles that lost a corner to the merge
+void weld_vertices(IndexedMesh& mesh) {
+    size_t n = mesh.vertices.size();
+    size_t table_size = 16;
+    while (table_size < 2 * n) table_size <<= 1;
+    const uint32_t empty = 0xffffffffu;
+    std::vector<uint32_t> table(table_size, empty);
+    std::vector<uint32_t> remap(n);
+    std::vector<Point3> welded;
+    welded.reserve(n);
+
+    for (size_t i = 0; i < n; i++) {
+        Point3 v = mesh.vertices[i];
+        uint64_t h = 0;
+        for (int a = 0; a < 3; a++) {
+            v[a] += 0.0;    // -0 becomes 0
+            uint64_t bits;
+            std::memcpy(&bits, &v.e[a], sizeof(bits));
+            h = (h ^ bits) * 0x9E3779B97F4A7C15ull;
+        }
+        size_t slot = (size_t)(h ^ (h >> 29)) & (table_size - 1);
+        while (table[slot] != empty) {
+            const Point3& w = welded[table[slot]];
+            if (w[0] == v[0] && w[1] == v[1] && w[2] == v[2]) break;
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (table[slot] == empty) {
+            table[slot] = (uint32_t)welded.size();
+            welded.push_back(v);
+        }
+        remap[i] = table[slot];
+    }
+    mesh.vertices.swap(welded);
+
+    size_t kept = 0;
+    bool per_face = !mesh.face_materials.empty();
+    for (size_t t = 0; t < mesh.indices.size() / 3; t++) {
+        uint32_t a = remap[mesh.indices[3 * t]];
+        uint32_t b = remap[mesh.indices[3 * t + 1]];
+        uint32_t c = remap[mesh.indices[3 * t + 2]];
+        if (a == b || b == c || a == c) continue;
+        mesh.indices[3 * kept] = a;
+        mesh.indices[3 * kept + 1] = b;
+        mesh.indices[3 * kept + 2] = c;
+        if (per_face) mesh.face_materials[kept] = mesh.face_materials[t];
+        kept++;
+    }
+    mesh.indices.resize(3 * kept);
+    if (per_face) mesh.face_materials.resize(kept);
+}
+
+
+// OBJ
+
+// one line aligned chunk of an OBJ file, decoded without knowing what came before it
+struct ObjChunk {
+    std::vector<double> positions;      // x y z per "v"
+    std::vector<int64_t> corners;       // 3 per triangle, >= 0 is a 0 based vertex, see obj_relative
+    std::vector<std::pair<uint32_t, std::string>> materials;   // usemtl: first triangle of the chunk it applies to, name
+};
+
+// negative OBJ indices count back from the last vertex so far, which a chunk only knows
+// relative to its own start. they are stored as (chunk vertex + index) - obj_relative and
+// resolved once the vertex offsets of the chunks are known
+const int64_t obj_relative = (int64_t)1 << 40;
+
+inline bool obj_keyword(const char* p, const char* end, const char* word, size_t length) {
+    return (size_t)(end - p) > length && std::memcmp(p, word, length) == 0 && (p[length] == ' ' || p[length] == '\t');
+}
+
+inline void obj_parse_chunk(const char* p, const char* end, ObjChunk& chunk, std::string& error) {
+    while (scan_next_record(p, end)) {
+        const char* line = p;
+        if (obj_keyword(p, end, "v", 1)) {
+            p += 1;
+            double x, y, z;
+            if (!scan_float(p, end, x) || !scan_float(p, end, y) || !scan_float(p, end, z)) {
+                error = "cannot read vertex line \"" + std::string(line, std::find(line, end, '\n')) + "\"";
+                return;
+            }
+            chunk.positions.push_back(x);
+            chunk.positions.push_back(y);
+            chunk.positions.push_back(z);
+        }
+        else if (obj_keyword(p, end, "f", 1)) {
+            p += 1;
+            int64_t first = 0, previous = 0;
+            int count = 0;
+            int64_t chunk_vertices = (int64_t)chunk.positions.size() / 3;
+            while (true) {
+                scan_skip_blanks(p, end);
+                if (p >= end || *p == '\n' || *p == '#') break;
+                long long index;
+                if (!scan_int(p, end, index) || index == 0) {
+                    error = "cannot read face line \"" + std::string(line, std::find(line, end, '\n')) + "\"";
+                    return;
+                }
+                // texture and normal indices after the slashes are not used
+                while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+
+                int64_t corner = index > 0 ? index - 1 : chunk_vertices + index - obj_relative;
+                if (count == 0) first = corner;
+                else if (count >= 2) {
+                    chunk.corners.push_back(first);
+                    chunk.corners.push_back(previous);
+                    chunk.corners.push_back(corner);
+                }
+                previous = corner;
+                count++;
+            }
+            if (count < 3) {
+                error = "face with less than 3 corners \"" + std::string(line, std::find(line, end, '\n')) + "\"";
+                return;
+            }
+        }
+        else if (obj_keyword(p, end, "usemtl", 6)) {
+            p += 6;
+            scan_skip_blanks(p, end);
+            const char* name_end = p;
+            while (name_end < end && *name_end != '\n' && *name_end != '\r') name_end++;
+            while (name_end > p && (name_end[-1] == ' ' || name_end[-1] == '\t')) name_end--;
+            chunk.materials.push_back(std::make_pair((uint32_t)(chunk.corners.size() / 3), std::string(p, name_end)));
+        }
+        // vt, vn, o, g, s, mtllib and anything else are skipped
+        scan_skip_line(p, end);
+    }
+}
+
+// material_names, when given, receives the usemtl names, name i has id options.material_id + i
+bool load_obj(const std::string& filename, IndexedMesh& mesh, const MeshImportOptions& options = MeshImportOptions(),
+              std::vector<std::string>* material_names = nullptr) {
+    MappedFile file;
+    if (!file.open(filename)) return false;
+
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+    int parts = scan_chunk_count(file.size(), options.threads);
+    std::vector<const char*> cuts = scan_line_chunks(begin, end, parts);
+    std::vector<ObjChunk> chunks(parts);
+
+    std::string error = scan_parallel(parts, [&](int i, std::string& chunk_error) {
+        obj_parse_chunk(cuts[i], cuts[i + 1], chunks[i], chunk_error);
+    });
+    if (!error.empty()) {
+        std::cerr << "OBJ: " << filename << ": " << error << "\n";
+        return false;
+    }
+
+    // where every chunk's vertices and triangles go, and the material it starts with
+    std::vector<size_t> vertex_offset(parts + 1, 0), triangle_offset(parts + 1, 0);
+    for (int i = 0; i < parts; i++) {
+        vertex_offset[i + 1] = vertex_offset[i] + chunks[i].positions.size() / 3;
+        triangle_offset[i + 1] = triangle_offset[i] + chunks[i].corners.size() / 3;
+    }
+    size_t vertex_count = vertex_offset[parts];
+    if (vertex_count >= 0xffffffffu) {
+        std::cerr << "OBJ: " << filename << ": too many vertices\n";
+        return false;
+    }
+
+    std::map<std::string, uint32_t> material_ids;
+    std::vector<std::string> names;
+    std::vector<std::vector<uint32_t>> chunk_material_ids(parts);
+    std::vector<uint32_t> start_material(parts);
+    uint32_t current = options.material_id;
+    for (int i = 0; i < parts; i++) {
+        start_material[i] = current;
+        for (const auto& use : chunks[i].materials) {
+            auto found = material_ids.find(use.second);
+            if (found == material_ids.end()) {
+                found = material_ids.insert(std::make_pair(use.second, options.material_id + (uint32_t)names.size())).first;
+                names.push_back(use.second);
+            }
+            current = found->second;
+            chunk_material_ids[i].push_back(current);
+        }
+    }
+    bool per_face = names.size() > 1;
+
+    mesh.vertices.resize(vertex_count);
+    mesh.indices.resize(triangle_offset[parts] * 3);
+    mesh.face_materials.assign(per_face ? triangle_offset[parts] : 0, 0);
+    mesh.material_id = options.material_id;
+
+    error = scan_parallel(parts, [&](int i, std::string& chunk_error) {
+        const ObjChunk& chunk = chunks[i];
+        for (size_t v = 0; v < chunk.positions.size() / 3; v++) {
+            mesh.vertices[vertex_offset[i] + v] = Point3(chunk.positions[3 * v], chunk.positions[3 * v + 1], chunk.positions[3 * v + 2]);
+        }
+        for (size_t c = 0; c < chunk.corners.size(); c++) {
+            int64_t corner = chunk.corners[c];
+            if (corner < 0) corner += obj_relative + (int64_t)vertex_offset[i];
+            if (corner < 0 || corner >= (int64_t)vertex_count) {
+                chunk_error = "face index out of range";
+                return;
+            }
+            mesh.indices[triangle_offset[i] * 3 + c] = (uint32_t)corner;
+        }
+        if (per_face) {
+            size_t tri = 0, triangles = chunk.corners.size() / 3;
+            uint32_t material = start_material[i];
+            for (size_t m = 0; m <= chunk.materials.size(); m++) {
+                size_t until = m < chunk.materials.size() ? chunk.materials[m].first : triangles;
+                for (; tri < until; tri++) mesh.face_materials[triangle_offset[i] + tri] = material;
+                if (m < chunk.materials.size()) material = chunk_material_ids[i][m];
+            }
+        }
+    });
+    if (!error.empty()) {
+        std::cerr << "OBJ: " << filename << ": " << error << "\n";
+        return false;
+    }
+
+    if (options.weld) weld_vertices(mesh);
+    if (material_names) *material_names = names;
+    return true;
+}
+
+
+// binary PLY
+
+enum PlyType { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID };
+
+inline PlyType ply_type(const std::string& name) {
+    if (name == "char" || name == "int8") return PLY_INT8;
+    if (name == "uchar" || name == "uint8") return PLY_UINT8;
+    if (name == "short" || name == "int16") return PLY_INT16;
+    if (name == "ushort" || name == "uint16") return PLY_UINT16;
+    if (name == "int" || name == "int32") return PLY_INT32;
+    if (name == "uint" || name == "uint32") return PLY_UINT32;
+    if (name == "float" || name == "float32") return PLY_FLOAT32;
+    if (name == "double" || name == "float64") return PLY_FLOAT64;
+    return PLY_INVALID;
+}
+
+inline size_t ply_size(PlyType type) {
+    static const size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+    return sizes[type];
+}
+
+// one value at p, swapped when the file's byte order is not the host's
+inline double ply_read(const char* p, PlyType type, bool swap) {
+    unsigned char b[8];
+    size_t size = ply_size(type);
+    if (swap) for (size_t i = 0; i < size; i++) b[i] = (unsigned char)p[size - 1 - i];
+    else std::memcpy(b, p, size);
+    switch (type) {
+        case PLY_INT8: { int8_t v; std::memcpy(&v, b, 1); return v; }
+        case PLY_UINT8: return b[0];
+        case PLY_INT16: { int16_t v; std::memcpy(&v, b, 2); return v; }
+        case PLY_UINT16: { uint16_t v; std::memcpy(&v, b, 2); return v; }
+        case PLY_INT32: { int32_t v; std::memcpy(&v, b, 4); return v; }
+        case PLY_UINT32: { uint32_t v; std::memcpy(&v, b, 4); return v; }
+        case PLY_FLOAT32: { float v; std::memcpy(&v, b, 4); return v; }
+        case PLY_FLOAT64: { double v; std::memcpy(&v, b, 8); return v; }
+        default: return 0.0;
+    }
+}
+
+struct PlyProperty {
+    std::string name;
+    PlyType type = PLY_INVALID;
+    PlyType count_type = PLY_INVALID;   // lists only
+    bool list = false;
+    size_t offset = 0;                  // in the record, for elements without lists
+};
+
+struct PlyElement {
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+    bool has_list = false;
+    size_t record_size = 0;             // for elements without lists
+};
+
+// size of the record at p of an element with lists, 0 when it runs past end
+inline size_t ply_record_size(const PlyElement& element, const char* p, const char* end, bool swap) {
+    size_t size = 0;
+    for (const PlyProperty& property : element.properties) {
+        if (!property.list) {
+            size += ply_size(property.type);
+            continue;
+        }
+        size_t count_size = ply_size(property.count_type);
+        if (p + size + count_size > end) return 0;
+        double count = ply_read(p + size, property.count_type, swap);
+        size += count_size + (size_t)count * ply_size(property.type);
+    }
+    return p + size <= end ? size : 0;
+}
+
+bool load_ply(const std::string& filename, IndexedMesh& mesh, const MeshImportOptions& options = MeshImportOptions()) {
+    MappedFile file;
+    if (!file.open(filename)) return false;
+    const char* p = file.data();
+    const char* end = p + file.size();
+
+    // header, one keyword line at a time
+    std::vector<PlyElement> elements;
+    bool binary = false, big_endian = false, header_done = false;
+    if (file.size() < 4 || std::memcmp(p, "ply", 3) != 0) {
+        std::cerr << "PLY: " << filename << " is not a PLY file\n";
+        return false;
+    }
+    while (p < end && !header_done) {
+        const char* line_end = std::find(p, end, '\n');
+        std::string line(p, line_end);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        p = line_end < end ? line_end + 1 : end;
+
+        std::vector<std::string> words;
+        size_t start = 0;
+        while (start < line.size()) {
+            size_t stop = line.find_first_of(" \t", start);
+            if (stop == std::string::npos) stop = line.size();
+            if (stop > start) words.push_back(line.substr(start, stop - start));
+            start = stop + 1;
+        }
+        if (words.empty()) continue;
+
+        if (words[0] == "format" && words.size() >= 2) {
+            binary = words[1] == "binary_little_endian" || words[1] == "binary_big_endian";
+            big_endian = words[1] == "binary_big_endian";
+        }
+        else if (words[0] == "element" && words.size() >= 3) {
+            PlyElement element;
+            element.name = words[1];
+            element.count = (size_t)std::strtoull(words[2].c_str(), nullptr, 10);
+            elements.push_back(element);
+        }
+        else if (words[0] == "property" && !elements.empty()) {
+            PlyProperty property;
+            if (words.size() >= 5 && words[1] == "list") {
+                property.list = true;
+                property.count_type = ply_type(words[2]);
+                property.type = ply_type(words[3]);
+                property.name = words[4];
+            }
+            else if (words.size() >= 3) {
+                property.type = ply_type(words[1]);
+                property.name = words[2];
+            }
+            if (property.type == PLY_INVALID || (property.list && property.count_type == PLY_INVALID)) {
+                std::cerr << "PLY: " << filename << ": unknown property \"" << line << "\"\n";
+                return false;
+            }
+            PlyElement& element = elements.back();
+            property.offset = element.record_size;
+            element.record_size += property.list ? 0 : ply_size(property.type);
+            element.has_list = element.has_list || property.list;
+            element.properties.push_back(property);
+        }
+        else if (words[0] == "end_header") {
+            header_done = true;
+        }
+    }
+    if (!header_done || !binary) {
+        std::cerr << "PLY: " << filename << (header_done ? ": only binary PLY files are supported\n" : ": no end_header\n");
+        return false;
+    }
+
+    uint32_t probe = 1;
+    unsigned char host_little;
+    std::memcpy(&host_little, &probe, 1);
+    bool swap = big_endian == (host_little == 1);
+
+    mesh.vertices.clear();
+    mesh.indices.clear();
+    mesh.face_materials.clear();
+    mesh.material_id = options.material_id;
+
+    size_t vertex_count = 0;
+    for (const PlyElement& element : elements) {
+        bool is_vertex = element.name == "vertex";
+        bool is_face = element.name == "face";
+
+        if (is_vertex) {
+            int axis[3] = { -1, -1, -1 };
+            for (size_t k = 0; k < element.properties.size(); k++) {
+                const std::string& name = element.properties[k].name;
+                if (name == "x") axis[0] = (int)k;
+                if (name == "y") axis[1] = (int)k;
+                if (name == "z") axis[2] = (int)k;
+            }
+            if (element.has_list || axis[0] < 0 || axis[1] < 0 || axis[2] < 0 || element.count >= 0xffffffffu ||
+                (size_t)(end - p) < element.count * element.record_size) {
+                std::cerr << "PLY: " << filename << ": bad vertex element\n";
+                return false;
+            }
+            vertex_count = element.count;
+            mesh.vertices.resize(vertex_count);
+            const PlyProperty* x = &element.properties[axis[0]];
+            const PlyProperty* y = &element.properties[axis[1]];
+            const PlyProperty* z = &element.properties[axis[2]];
+            const char* records = p;
+            int parts = scan_chunk_count(vertex_count * element.record_size, options.threads);
+            scan_parallel(parts, [&](int i, std::string&) {
+                for (size_t v = vertex_count * i / parts; v < vertex_count * (i + 1) / parts; v++) {
+                    const char* r = records + v * element.record_size;
+                    mesh.vertices[v] = Point3(ply_read(r + x->offset, x->type, swap), ply_read(r + y->offset, y->type, swap),
+                                              ply_read(r + z->offset, z->type, swap));
+                }
+            });
+            p += element.count * element.record_size;
+            continue;
+        }
+
+        if (!is_face) {
+            // skipped, records with lists have to be walked
+            if (!element.has_list) {
+                if ((size_t)(end - p) < element.count * element.record_size) {
+                    std::cerr << "PLY: " << filename << ": file ends inside " << element.name << "\n";
+                    return false;
+                }
+                p += element.count * element.record_size;
+                continue;
+            }
+            for (size_t r = 0; r < element.count; r++) {
+                size_t size = ply_record_size(element, p, end, swap);
+                if (size == 0) {
+                    std::cerr << "PLY: " << filename << ": file ends inside " << element.name << "\n";
+                    return false;
+                }
+                p += size;
+            }
+            continue;
+        }
+
+        int indices_property = -1, material_property = -1;
+        for (size_t k = 0; k < element.properties.size(); k++) {
+            const PlyProperty& property = element.properties[k];
+            if (property.list && (property.name == "vertex_indices" || property.name == "vertex_index")) indices_property = (int)k;
+            if (!property.list && (property.name == "material_index" || property.name == "material")) material_property = (int)k;
+        }
+        if (indices_property < 0) {
+            std::cerr << "PLY: " << filename << ": faces without vertex_indices\n";
+            return false;
+        }
+
+        // one serial walk finds where every chunk of faces starts and how many triangles
+        // come before it, then the chunks are decoded in parallel
+        int parts = scan_chunk_count((size_t)(end - p), options.threads);
+        std::vector<const char*> chunk_start(parts + 1);
+        std::vector<size_t> first_face(parts + 1), first_triangle(parts + 1);
+        size_t triangles = 0;
+        int chunk = 0;
+        for (size_t f = 0; f < element.count; f++) {
+            while (chunk < parts && f == element.count * chunk / parts) {
+                chunk_start[chunk] = p;
+                first_face[chunk] = f;
+                first_triangle[chunk] = triangles;
+                chunk++;
+            }
+            size_t size = ply_record_size(element, p, end, swap);
+            if (size == 0) {
+                std::cerr << "PLY: " << filename << ": file ends inside the faces\n";
+                return false;
+            }
+            // corner count of the index list
+            size_t before = 0;
+            for (int k = 0; k < indices_property; k++) {
+                const PlyProperty& property = element.properties[k];
+                before += property.list ? ply_size(property.count_type) + (size_t)ply_read(p + before, property.count_type, swap) * ply_size(property.type)
+                                        : ply_size(property.type);
+            }
+            size_t corners = (size_t)ply_read(p + before, element.properties[indices_property].count_type, swap);
+            if (corners < 3) {
+                std::cerr << "PLY: " << filename << ": face " << f << " has " << corners << " corners\n";
+                return false;
+            }
+            triangles += corners - 2;
+            p += size;
+        }
+        while (chunk <= parts) {
+            chunk_start[chunk] = p;
+            first_face[chunk] = element.count;
+            first_triangle[chunk] = triangles;
+            chunk++;
+        }
+
+        mesh.indices.resize(triangles * 3);
+        if (material_property >= 0) mesh.face_materials.resize(triangles);
+
+        std::string error = scan_parallel(parts, [&](int i, std::string& chunk_error) {
+            const char* r = chunk_start[i];
+            size_t tri = first_triangle[i];
+            for (size_t f = first_face[i]; f < first_face[i + 1]; f++) {
+                uint32_t material = options.material_id;
+                uint32_t first = 0, previous = 0;
+                size_t face_triangles = tri;
+                for (int k = 0; k < (int)element.properties.size(); k++) {
+                    const PlyProperty& property = element.properties[k];
+                    if (!property.list) {
+                        if (k == material_property) {
+                            double value = ply_read(r, property.type, swap);
+                            if (value < 0 || value > (double)(0xffffffffu - options.material_id)) {
+                                chunk_error = "face " + std::to_string(f) + " has material " + std::to_string((long long)value);
+                                return;
+                            }
+                            material += (uint32_t)value;
+                        }
+                        r += ply_size(property.type);
+                        continue;
+                    }
+                    size_t count = (size_t)ply_read(r, property.count_type, swap);
+                    r += ply_size(property.count_type);
+                    if (k != indices_property) {
+                        r += count * ply_size(property.type);
+                        continue;
+                    }
+                    for (size_t c = 0; c < count; c++, r += ply_size(property.type)) {
+                        double index = ply_read(r, property.type, swap);
+                        if (index < 0 || index >= (double)vertex_count) {
+                            chunk_error = "face " + std::to_string(f) + " uses vertex " + std::to_string((long long)index) +
+                                          ", there are " + std::to_string(vertex_count);
+                            return;
+                        }
+                        uint32_t corner = (uint32_t)index;
+                        if (c == 0) first = corner;
+                        else if (c >= 2) {
+                            mesh.indices[3 * tri] = first;
+                            mesh.indices[3 * tri + 1] = previous;
+                            mesh.indices[3 * tri + 2] = corner;
+                            tri++;
+                        }
+                        previous = corner;
+                    }
+                }
+                // the material may come after the indices in the record
+                if (material_property >= 0) {
+                    for (; face_triangles < tri; face_triangles++) mesh.face_materials[face_triangles] = material;
+                }
+            }
+        });
+        if (!error.empty()) {
+            std::cerr << "PLY: " << filename << ": " << error << "\n";
+            return false;
+        }
+    }
+
+    // like OBJ, a single material goes into material_id instead of a per face array
+    if (!mesh.face_materials.empty() &&
+        std::all_of(mesh.face_materials.begin(), mesh.face_materials.end(), [&](uint32_t m) { return m == mesh.face_materials[0]; })) {
+        mesh.material_id = mesh.face_materials[0];
+        mesh.face_materials.clear();
+    }
+
+    if (options.weld) weld_vertices(mesh);
+    return true;
+}
+
+#endif
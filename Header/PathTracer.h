@@ -0,0 +1,253 @@
+#ifndef PATHTRACER_H
+#define PATHTRACER_H
+
+#include "Renderer.h"
+#include "Camera.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// multithreaded render loop for Camera + Hittable scenes. the image is cut into square
+// tiles that the threads take from a shared counter, so fast and slow regions balance out.
+// every pixel restarts the thread's Philox stream at (pixel, pass), which makes the image
+// the same for any number of threads.
+
+struct RenderSettings {
+    int width = 400;
+    int height = 225;
+    int samples_per_pixel = 16;
+    int max_depth = 50;             // bounces before a path is cut off
+    int tile_size = 16;
+    int threads = 0;                // 0 uses every core
+    bool sky = true;                // blue-white gradient when a ray escapes, else background
+    Color background = Color(0, 0, 0);
+    uint64_t seed = PHILOX_DEFAULT_SEED;
+};
+
+// radiance along r. iterative, the throughput carries the product of the attenuations
+Color ray_color(const Ray& r, const Hittable& world, const MaterialTable& materials, const RenderSettings& settings) {
+    Color radiance(0, 0, 0);
+    Color throughput(1, 1, 1);
+    Ray ray = r;
+
+    for (int depth = 0; depth < settings.max_depth; depth++) {
+        hit_record rec;
+        if (!world.hit(ray, 0.001, infinity, rec)) {
+            Color background = settings.background;
+            if (settings.sky) {
+                auto t = 0.5 * (unit_vector(ray.direction()).y() + 1.0);
+                background = (1.0 - t) * Color(1.0, 1.0, 1.0) + t * Color(0.5, 0.7, 1.0);
+            }
+            return radiance + throughput * background;
+        }
+
+        const Material& material = materials[rec.material_id];
+        radiance += throughput * material.emitted(rec.u, rec.v, rec.p);
+
+        Ray scattered;
+        Color attenuation;
+        if (!material.scatter(ray, rec, attenuation, scattered))
+            return radiance;
+        throughput = throughput * attenuation;
+        ray = scattered;
+    }
+    return radiance;
+}
+
+// one camera sample through pixel (i, row), drawn from the thread's random stream
+inline Color sample_pixel(const Camera& cam, const Hittable& world, const MaterialTable& materials,
+                          const RenderSettings& settings, int i, int row) {
+    int j = settings.height - 1 - row;
+    auto u = (i + random_double()) / (settings.width - 1);
+    auto v = (j + random_double()) / (settings.height - 1);
+    return ray_color(cam.get_ray(u, v), world, materials, settings);
+}
+
+// pixel range of a tile
+inline void tile_bounds(const RenderSettings& settings, int tile, int& x0, int& y0, int& x1, int& y1) {
+    int tiles_x = (settings.width + settings.tile_size - 1) / settings.tile_size;
+    x0 = (tile % tiles_x) * settings.tile_size;
+    y0 = (tile / tiles_x) * settings.tile_size;
+    x1 = std::min(x0 + settings.tile_size, settings.width);
+    y1 = std::min(y0 + settings.tile_size, settings.height);
+}
+
+// runs fn(tile) for every tile of the image on settings.threads threads
+template <typename F>
+void for_each_tile(const RenderSettings& settings, F fn) {
+    int tiles_x = (settings.width + settings.tile_size - 1) / settings.tile_size;
+    int tiles_y = (settings.height + settings.tile_size - 1) / settings.tile_size;
+    int tiles = tiles_x * tiles_y;
+    int n_threads = settings.threads > 0 ? settings.threads : std::max(1, (int)std::thread::hardware_concurrency());
+    n_threads = std::min(n_threads, tiles);
+
+    std::atomic<int> next_tile(0);
+    auto worker = [&]() {
+        for (int tile = next_tile++; tile < tiles; tile = next_tile++) {
+            fn(tile);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < n_threads; t++) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (std::thread& thread : threads) thread.join();
+}
+
+// renders settings.samples_per_pixel samples into pixels, which hold per pixel sums
+// (write_img_jpg divides by the sample count). pixels are stored top row first
+std::vector<Color> render(const Camera& cam, const Hittable& world, const MaterialTable& materials, const RenderSettings& settings) {
+    std::vector<Color> pixels(settings.width * settings.height, Color(0, 0, 0));
+
+    int tiles_x = (settings.width + settings.tile_size - 1) / settings.tile_size;
+    int tiles_y = (settings.height + settings.tile_size - 1) / settings.tile_size;
+    int tiles = tiles_x * tiles_y;
+    std::atomic<int> tiles_done(0);
+
+    for_each_tile(settings, [&](int tile) {
+        int x0, y0, x1, y1;
+        tile_bounds(settings, tile, x0, y0, x1, y1);
+        for (int row = y0; row < y1; row++) {
+            for (int i = x0; i < x1; i++) {
+                uint32_t pixel = (uint32_t)(row * settings.width + i);
+                thread_rng() = PhiloxStream(pixel, 0, settings.seed);
+                for (int s = 0; s < settings.samples_per_pixel; s++) {
+                    pixels[pixel] += sample_pixel(cam, world, materials, settings, i, row);
+                }
+            }
+        }
+        int done = ++tiles_done;
+        if (done % std::max(1, tiles / 20) == 0)
+            std::cerr << "\rTiles done: " << done << " / " << tiles << ' ' << std::flush;
+    });
+
+    std::cerr << "\nDone.\n";
+    return pixels;
+}
+
+// progressive rendering: every pass adds one sample to each pixel that has not converged yet.
+// a pixel stops once the standard error of its mean luminance drops below
+// tolerance * mean (after at least min_samples), so flat background stops early and the
+// budget goes to noisy pixels. image() can be written with write_img_jpg between passes.
+class ProgressiveRenderer {
+    public:
+        ProgressiveRenderer(const RenderSettings& render_settings, int min_pixel_samples = 16, double relative_tolerance = 0.02)
+            : settings(render_settings), min_samples(min_pixel_samples), tolerance(relative_tolerance),
+              pixels(render_settings.width * render_settings.height), passes(0), active((int)pixels.size()) {}
+
+        // one sample for every active pixel, returns the number of pixels still active
+        int pass(const Camera& cam, const Hittable& world, const MaterialTable& materials);
+
+        // passes until every pixel converged or has settings.samples_per_pixel samples.
+        // with a preview file the current image is written every preview_interval passes
+        void run(const Camera& cam, const Hittable& world, const MaterialTable& materials,
+                 int preview_interval = 0, const char* preview_filename = nullptr);
+
+        // mean color per pixel, write it with samples_per_pixel = 1
+        std::vector<Color> image() const;
+
+        // samples taken per pixel relative to the maximum, to see where the budget went
+        std::vector<Color> sample_map() const;
+
+        int pass_count() const { return passes; }
+        int active_pixels() const { return active; }
+
+    private:
+        struct PixelStats {
+            float sum[3] = { 0, 0, 0 };
+            float luminance_sum = 0;
+            float luminance_sum_sq = 0;
+            uint32_t samples = 0;
+            bool converged = false;
+        };
+
+        bool converged(const PixelStats& p) const;
+
+    public:
+        RenderSettings settings;
+        int min_samples;
+        double tolerance;
+
+    private:
+        std::vector<PixelStats> pixels;
+        int passes;
+        int active;
+};
+
+bool ProgressiveRenderer::converged(const PixelStats& p) const {
+    if ((int)p.samples < min_samples) return false;
+    double n = p.samples;
+    double mean = p.luminance_sum / n;
+    double variance = std::max(0.0, (p.luminance_sum_sq / n - mean * mean) * n / (n - 1));
+    // the small floor keeps black pixels from sampling forever
+    return std::sqrt(variance / n) <= tolerance * std::max(mean, 1e-3);
+}
+
+int ProgressiveRenderer::pass(const Camera& cam, const Hittable& world, const MaterialTable& materials) {
+    if (active == 0 || passes >= settings.samples_per_pixel) return 0;
+
+    std::atomic<int> still_active(0);
+    uint32_t pass_index = (uint32_t)passes;
+    for_each_tile(settings, [&](int tile) {
+        int x0, y0, x1, y1;
+        tile_bounds(settings, tile, x0, y0, x1, y1);
+        int tile_active = 0;
+        for (int row = y0; row < y1; row++) {
+            for (int i = x0; i < x1; i++) {
+                uint32_t index = (uint32_t)(row * settings.width + i);
+                PixelStats& p = pixels[index];
+                if (p.converged) continue;
+
+                thread_rng() = PhiloxStream(index, pass_index, settings.seed);
+                Color c = sample_pixel(cam, world, materials, settings, i, row);
+                float luminance = (float)(0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z());
+                for (int k = 0; k < 3; k++) p.sum[k] += (float)c[k];
+                p.luminance_sum += luminance;
+                p.luminance_sum_sq += luminance * luminance;
+                p.samples++;
+
+                p.converged = converged(p);
+                if (!p.converged) tile_active++;
+            }
+        }
+        still_active += tile_active;
+    });
+
+    passes++;
+    active = still_active;
+    return active;
+}
+
+void ProgressiveRenderer::run(const Camera& cam, const Hittable& world, const MaterialTable& materials,
+                              int preview_interval, const char* preview_filename) {
+    while (pass(cam, world, materials) > 0) {
+        std::cerr << "\rPass " << passes << ", active pixels: " << active << ' ' << std::flush;
+        if (preview_filename && preview_interval > 0 && passes % preview_interval == 0)
+            write_img_jpg(image(), preview_filename, settings.width, settings.height, 1);
+    }
+    std::cerr << "\nDone.\n";
+}
+
+std::vector<Color> ProgressiveRenderer::image() const {
+    std::vector<Color> out(pixels.size(), Color(0, 0, 0));
+    for (size_t i = 0; i < pixels.size(); i++) {
+        if (pixels[i].samples == 0) continue;
+        double scale = 1.0 / pixels[i].samples;
+        out[i] = Color(pixels[i].sum[0] * scale, pixels[i].sum[1] * scale, pixels[i].sum[2] * scale);
+    }
+    return out;
+}
+
+std::vector<Color> ProgressiveRenderer::sample_map() const {
+    std::vector<Color> out(pixels.size());
+    for (size_t i = 0; i < pixels.size(); i++) {
+        double f = (double)pixels[i].samples / std::max(1, settings.samples_per_pixel);
+        out[i] = Color(f, f, f);
+    }
+    return out;
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <cstdint>
+
+// Philox4x32-10 counter based random numbers
+// (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", 2011).
+// a random number is a pure function of (id, sample, pass, stream) and the seed, so any
+// thread or device can generate any sample on its own and gets the same value every run.
+// kernel.cl has the same generator, keep both in sync.
+
+const uint64_t PHILOX_DEFAULT_SEED = 0x243F6A8885A308D3ull;
+
+struct philox4 {
+    uint32_t v[4];
+};
+
+inline philox4 philox4x32(philox4 ctr, uint64_t seed) {
+    uint32_t k0 = (uint32_t)seed;
+    uint32_t k1 = (uint32_t)(seed >> 32);
+
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = (uint64_t)0xD2511F53u * ctr.v[0];
+        uint64_t p1 = (uint64_t)0xCD9E8D57u * ctr.v[2];
+
+        philox4 next = {{
+            (uint32_t)(p1 >> 32) ^ ctr.v[1] ^ k0,
+            (uint32_t)p1,
+            (uint32_t)(p0 >> 32) ^ ctr.v[3] ^ k1,
+            (uint32_t)p0
+        }};
+        ctr = next;
+
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+    return ctr;
+}
+
+// 24 bit float in [0,1), exactly representable so host and OpenCL results match bit for bit
+inline float philox_to_float(uint32_t x) {
+    return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+// four uniforms in [0,1) for vertex/pixel id, sample index and pass.
+// stream picks further independent blocks of four for the same sample
+inline void random_uniform4(uint32_t id, uint32_t sample, uint32_t pass, uint32_t stream, float out[4], uint64_t seed = PHILOX_DEFAULT_SEED) {
+    philox4 ctr = {{ id, sample, pass, stream }};
+    philox4 r = philox4x32(ctr, seed);
+    for (int i = 0; i < 4; i++) {
+        out[i] = philox_to_float(r.v[i]);
+    }
+}
+
+// a single uniform in [0,1), dim counts the random dimensions used by one sample
+inline float random_uniform(uint32_t id, uint32_t sample, uint32_t pass, uint32_t dim, uint64_t seed = PHILOX_DEFAULT_SEED) {
+    float r[4];
+    random_uniform4(id, sample, pass, dim / 4, r, seed);
+    return r[dim % 4];
+}
+
+// sequential draws on top of the counter, for code that just wants "the next number".
+// each (id, pass) is its own stream, blocks are counted in the sample slot
+class PhiloxStream {
+    public:
+        PhiloxStream(uint32_t stream_id = 0, uint32_t stream_pass = 0, uint64_t stream_seed = PHILOX_DEFAULT_SEED)
+            : id(stream_id), pass(stream_pass), seed(stream_seed), block(0), used(4) {}
+
+        uint32_t next_uint() {
+            if (used == 4) {
+                philox4 ctr = {{ id, block++, pass, 0 }};
+                buffer = philox4x32(ctr, seed);
+                used = 0;
+            }
+            return buffer.v[used++];
+        }
+
+        float next_float() {
+            return philox_to_float(next_uint());
+        }
+
+        // 53 bit double in [0,1)
+        double next_double() {
+            uint64_t hi = next_uint() >> 5;
+            uint64_t lo = next_uint() >> 6;
+            return (hi * 67108864.0 + lo) * (1.0 / 9007199254740992.0);
+        }
+
+    private:
+        uint32_t id;
+        uint32_t pass;
+        uint64_t seed;
+        uint32_t block;
+        uint32_t used;
+        philox4 buffer;
+};
+
+#endif
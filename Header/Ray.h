@@ -2,24 +2,13 @@
 #define RAY_H
 
 #include "vec3.h"
+#include "RayN.h"
 
-class Ray{
+// ray over the scalar type of vec3_t, Ray is double and Rayf float
+template <typename T>
+using Ray_t = RayN<3, T>;
 
-    private: 
-        Point3 orig;
-        vec3 dir;
-
-    public:
-        Ray(){}
-        Ray(const Point3& origin, const vec3& direction)
-            : orig(origin), dir(direction) {}
-        
-        Point3 origin() const {return orig;}
-        vec3 direction() const {return dir;}
-
-        Point3 at (double t) const {
-            return orig + t*dir;
-        }
-};
+using Ray = Ray_t<double>;
+using Rayf = Ray_t<float>;
 
 #endif
\ No newline at end of file
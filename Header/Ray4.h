@@ -2,28 +2,13 @@
 #define RAY4_H
 
 #include "vec4.h"
+#include "RayN.h"
 
-class Ray4 {
+// 4D ray over the scalar type of vec4_t, Ray4 is double and Ray4f float
+template <typename T>
+using Ray4_t = RayN<4, T>;
 
-private:
-    Point4 orig;
-    vec4 dir;
-
-public:
-    Ray4() {}
-    Ray4(const Point4& origin, const vec4& direction)
-        : orig(origin), dir(direction) {}
-
-    Point4 origin() const { return orig; }
-    vec4 direction() const { return dir; }
-
-    //need a 2nd parameter...?
-    Point4 at(double t) const {
-        return orig + t * dir;
-    }
-
-
-
-};
+using Ray4 = Ray4_t<double>;
+using Ray4f = Ray4_t<float>;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef RAYN_H
+#define RAYN_H
+
+#include "VecN.h"
+
+// D dimensional ray over the scalar type T, Ray_t and Ray4_t are RayN<3, T> and RayN<4, T>
+template <int D, typename T>
+class RayN {
+
+    private:
+        VecN<D, T> orig;
+        VecN<D, T> dir;
+
+    public:
+        typedef T scalar;
+        static const int dimension = D;
+
+        RayN() {}
+        RayN(const VecN<D, T>& origin, const VecN<D, T>& direction)
+            : orig(origin), dir(direction) {}
+
+        template <typename U>
+        explicit RayN(const RayN<D, U>& r)
+            : orig(r.origin()), dir(r.direction()) {}
+
+        VecN<D, T> origin() const { return orig; }
+        VecN<D, T> direction() const { return dir; }
+
+        VecN<D, T> at(T t) const {
+            return orig + t * dir;
+        }
+};
+
+#endif
@@ -8,8 +8,8 @@ class XY_Rectangle : public Hittable {
         XY_Rectangle() {}
 
         XY_Rectangle(double _x0, double _x1, double _y0, double _y1, double _k,
-            shared_ptr<Material> mat)
-            : x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k), mp(mat) {};
+            uint32_t mat)
+            : x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k), material_id(mat) {};
 
         virtual bool hit(const Ray& r, double t0, double t1, hit_record& rec) const override;
 
@@ -27,7 +27,7 @@ class XY_Rectangle : public Hittable {
         }
 
     public:
-        shared_ptr<Material> mp;
+        uint32_t material_id;
         double x0, x1, y0, y1, k;
 };
 
@@ -36,8 +36,8 @@ class XZ_Rectangle : public Hittable {
         XZ_Rectangle() {}
 
         XZ_Rectangle(double _x0, double _x1, double _z0, double _z1, double _k,
-            shared_ptr<Material> mat)
-            : x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), mp(mat) {};
+            uint32_t mat)
+            : x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), material_id(mat) {};
 
         virtual bool hit(const Ray& r, double t0, double t1, hit_record& rec) const override;
 
@@ -53,7 +53,7 @@ class XZ_Rectangle : public Hittable {
         }
 
     public:
-        shared_ptr<Material> mp;
+        uint32_t material_id;
         double x0, x1, z0, z1, k;
 };
 
@@ -62,8 +62,8 @@ class YZ_Rectangle : public Hittable {
         YZ_Rectangle() {}
 
         YZ_Rectangle(double _y0, double _y1, double _z0, double _z1, double _k,
-            shared_ptr<Material> mat)
-            : y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), mp(mat) {};
+            uint32_t mat)
+            : y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), material_id(mat) {};
 
         virtual bool hit(const Ray& r, double t0, double t1, hit_record& rec) const override;
 
@@ -79,7 +79,7 @@ class YZ_Rectangle : public Hittable {
         }
 
     public:
-        shared_ptr<Material> mp;
+        uint32_t material_id;
         double y0, y1, z0, z1, k;
 };
 
@@ -96,7 +96,7 @@ bool XY_Rectangle::hit(const Ray& r, double t0, double t1, hit_record& rec) cons
     rec.t = t;
     auto outward_normal = vec3(0, 0, 1);
     rec.set_face_normal(r, outward_normal);
-    rec.material_ptr = mp;
+    rec.material_id = material_id;
     rec.p = r.at(t);
     return true;
 }
@@ -114,7 +114,7 @@ bool XZ_Rectangle::hit(const Ray& r, double t0, double t1, hit_record& rec) cons
     rec.t = t;
     auto outward_normal = vec3(0, 1, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.material_ptr = mp;
+    rec.material_id = material_id;
     rec.p = r.at(t);
     return true;
 }
@@ -132,7 +132,7 @@ bool YZ_Rectangle::hit(const Ray& r, double t0, double t1, hit_record& rec) cons
     rec.t = t;
     auto outward_normal = vec3(1, 0, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.material_ptr = mp;
+    rec.material_id = material_id;
     rec.p = r.at(t);
     return true;
 }
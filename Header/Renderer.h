@@ -7,6 +7,9 @@
 #include <memory>
 #include <vector>
 #include <random>
+#include <atomic>
+
+#include "Philox.h"
 
 #include <CL/cl.h>
 #include <CL/opencl.h>
@@ -29,11 +32,19 @@ inline double degrees_to_radians(double degrees) {
     return degrees * pi / 180.0;
 }
 
+//the calling thread's random stream. a render loop can reset it per pixel,
+//e.g. thread_rng() = PhiloxStream(pixel, pass), to get the same image on any number of threads
+inline PhiloxStream& thread_rng() {
+    static std::atomic<uint32_t> next_thread(0);
+    thread_local PhiloxStream stream(next_thread++);
+    return stream;
+}
+
 //returns a random real number in [0,1)
+//every thread draws from its own Philox stream, so this is safe to call from several threads.
+//code that needs reproducible samples should index random_uniform by (pixel, sample, pass) instead
 inline double random_double() {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+    return thread_rng().next_double();
 }
 
 //return a random real number in [min,max)
@@ -0,0 +1,373 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "Renderer.h"
+#include "Hittable.h"
+#include "LinearBVH.h"
+
+#include <cstdint>
+
+// scene with one contiguous array per primitive type instead of a list of Hittable pointers.
+// the BVH keeps every leaf to a single type, so the type is switched on once per leaf and the
+// primitive tests below are plain inline functions the compiler can see through.
+// anything else can still be added as a Hittable and goes through the virtual hit.
+
+enum PrimitiveType : uint8_t {
+    PRIMITIVE_SPHERE,
+    PRIMITIVE_TRIANGLE,
+    PRIMITIVE_RECTANGLE,
+    PRIMITIVE_BOX,
+    PRIMITIVE_HITTABLE,
+    PRIMITIVE_TYPES
+};
+
+struct SpherePrimitive {
+    Point3 center;
+    double radius;
+    uint32_t material_id;
+};
+
+// Moller-Trumbore needs the edges from v0, they are stored instead of the other two vertices
+struct TrianglePrimitive {
+    Point3 v0;
+    vec3 e1;
+    vec3 e2;
+    vec3 normal;
+    uint32_t material_id;
+};
+
+// axis aligned rectangle at coordinate k of its normal axis, like XY_Rectangle (axis 2),
+// XZ_Rectangle (axis 1) and YZ_Rectangle (axis 0). a and b are the two other axes in order
+struct RectanglePrimitive {
+    double a0, a1, b0, b1, k;
+    int axis;
+    uint32_t material_id;
+};
+
+struct BoxPrimitive {
+    Point3 box_min;
+    Point3 box_max;
+    uint32_t material_id;
+};
+
+inline bool hit_sphere(const SpherePrimitive& s, const Ray& r, double t_min, double t_max, hit_record& rec) {
+    vec3 oc = r.origin() - s.center;
+    auto a = r.direction().length_squared();
+    auto half_b = dot(oc, r.direction());
+    auto c = oc.length_squared() - s.radius * s.radius;
+    auto discriminant = half_b * half_b - a * c;
+    if (discriminant <= 0) return false;
+
+    auto root = sqrt(discriminant);
+    auto temp = (-half_b - root) / a;
+    if (!(temp < t_max && temp > t_min)) {
+        temp = (-half_b + root) / a;
+        if (!(temp < t_max && temp > t_min)) return false;
+    }
+
+    rec.t = temp;
+    rec.p = r.at(rec.t);
+    rec.set_face_normal(r, (rec.p - s.center) / s.radius);
+    rec.material_id = s.material_id;
+    return true;
+}
+
+inline bool hit_triangle(const TrianglePrimitive& tri, const Ray& r, double t_min, double t_max, hit_record& rec) {
+    double t, u, v;
+    if (!intersect_triangle(tri.v0, tri.e1, tri.e2, r, t_min, t_max, t, u, v)) return false;
+
+    rec.t = t;
+    rec.u = u;
+    rec.v = v;
+    rec.p = r.at(t);
+    rec.set_face_normal(r, tri.normal);
+    rec.material_id = tri.material_id;
+    return true;
+}
+
+inline bool hit_rectangle(const RectanglePrimitive& rect, const Ray& r, double t0, double t1, hit_record& rec) {
+    int a = (rect.axis == 0) ? 1 : 0;
+    int b = (rect.axis == 2) ? 1 : 2;
+
+    auto t = (rect.k - r.origin()[rect.axis]) / r.direction()[rect.axis];
+    if (t < t0 || t > t1)
+        return false;
+    auto x = r.origin()[a] + t * r.direction()[a];
+    auto y = r.origin()[b] + t * r.direction()[b];
+    if (x < rect.a0 || x > rect.a1 || y < rect.b0 || y > rect.b1)
+        return false;
+
+    rec.u = (x - rect.a0) / (rect.a1 - rect.a0);
+    rec.v = (y - rect.b0) / (rect.b1 - rect.b0);
+    rec.t = t;
+    vec3 outward_normal(0, 0, 0);
+    outward_normal[rect.axis] = 1;
+    rec.set_face_normal(r, outward_normal);
+    rec.material_id = rect.material_id;
+    rec.p = r.at(t);
+    return true;
+}
+
+// slab test instead of six rectangle tests, same hits and face uv as Box
+inline bool hit_box(const BoxPrimitive& box, const Ray& r, double t0, double t1, hit_record& rec) {
+    double t_enter = -infinity, t_exit = infinity;
+    int enter_axis = 0, exit_axis = 0;
+    for (int a = 0; a < 3; a++) {
+        double inv_d = 1.0 / r.direction()[a];
+        double ta = (box.box_min[a] - r.origin()[a]) * inv_d;
+        double tb = (box.box_max[a] - r.origin()[a]) * inv_d;
+        if (inv_d < 0) std::swap(ta, tb);
+        if (ta > t_enter) { t_enter = ta; enter_axis = a; }
+        if (tb < t_exit) { t_exit = tb; exit_axis = a; }
+    }
+    if (t_enter > t_exit) return false;
+
+    double t;
+    int axis;
+    if (t_enter >= t0 && t_enter <= t1) {
+        t = t_enter;
+        axis = enter_axis;
+    }
+    else if (t_exit >= t0 && t_exit <= t1) {
+        t = t_exit;
+        axis = exit_axis;
+    }
+    else return false;
+
+    int a = (axis == 0) ? 1 : 0;
+    int b = (axis == 2) ? 1 : 2;
+    rec.t = t;
+    rec.p = r.at(t);
+    rec.u = (rec.p[a] - box.box_min[a]) / (box.box_max[a] - box.box_min[a]);
+    rec.v = (rec.p[b] - box.box_min[b]) / (box.box_max[b] - box.box_min[b]);
+
+    // the six sides of Box all face +axis
+    vec3 outward_normal(0, 0, 0);
+    outward_normal[axis] = 1;
+    rec.set_face_normal(r, outward_normal);
+    rec.material_id = box.material_id;
+    return true;
+}
+
+class Scene : public Hittable {
+    public:
+        Scene() {}
+
+        void add_sphere(const Point3& center, double radius, uint32_t material_id);
+        void add_triangle(const Point3& a, const Point3& b, const Point3& c, uint32_t material_id);
+        // axis is the normal axis: 2 for XY, 1 for XZ and 0 for YZ rectangles
+        void add_rectangle(int axis, double a0, double a1, double b0, double b1, double k, uint32_t material_id);
+        void add_box(const Point3& p0, const Point3& p1, uint32_t material_id);
+        void add(shared_ptr<Hittable> object) { hittables.push_back(object); }
+
+        // builds the BVH and sorts the arrays into leaf order, call after adding the primitives
+        void build(const BVHBuildOptions& build_options = BVHBuildOptions());
+
+        virtual bool hit(const Ray& r, double tmin, double tmax, hit_record& rec) const override;
+
+        virtual bool bounding_box(double t0, double t1, BoundingBox& output_box) const override;
+
+        size_t primitive_count() const {
+            return spheres.size() + triangles.size() + rectangles.size() + boxes.size() + hittables.size();
+        }
+
+    private:
+        // a BVHN prim is the primitive's index in its type's array, the type in the top bits
+        static const int TYPE_SHIFT = 29;
+        static const uint32_t INDEX_MASK = (1u << TYPE_SHIFT) - 1;
+
+        bool hit_leaf(const uint32_t* prims, int count, const Ray& r, double tmin, double tmax, hit_record& rec) const;
+
+        void primitive_bounds(PrimitiveType type, size_t i, double lo[3], double hi[3]) const;
+
+        template <typename T>
+        static void reorder(std::vector<T>& items, const std::vector<uint32_t>& order);
+
+    public:
+        std::vector<SpherePrimitive> spheres;
+        std::vector<TrianglePrimitive> triangles;
+        std::vector<RectanglePrimitive> rectangles;
+        std::vector<BoxPrimitive> boxes;
+        std::vector<shared_ptr<Hittable>> hittables;
+
+        MaterialTable materials;
+        BVHN<3> bvh;
+};
+
+void Scene::add_sphere(const Point3& center, double radius, uint32_t material_id) {
+    spheres.push_back({ center, radius, material_id });
+}
+
+void Scene::add_triangle(const Point3& a, const Point3& b, const Point3& c, uint32_t material_id) {
+    vec3 e1 = b - a;
+    vec3 e2 = c - a;
+    triangles.push_back({ a, e1, e2, unit_vector(cross(e1, e2)), material_id });
+}
+
+void Scene::add_rectangle(int axis, double a0, double a1, double b0, double b1, double k, uint32_t material_id) {
+    rectangles.push_back({ a0, a1, b0, b1, k, axis, material_id });
+}
+
+void Scene::add_box(const Point3& p0, const Point3& p1, uint32_t material_id) {
+    boxes.push_back({ p0, p1, material_id });
+}
+
+void Scene::primitive_bounds(PrimitiveType type, size_t i, double lo[3], double hi[3]) const {
+    switch (type) {
+    case PRIMITIVE_SPHERE:
+        for (int a = 0; a < 3; a++) {
+            lo[a] = spheres[i].center[a] - spheres[i].radius;
+            hi[a] = spheres[i].center[a] + spheres[i].radius;
+        }
+        break;
+    case PRIMITIVE_TRIANGLE:
+        for (int a = 0; a < 3; a++) {
+            double v0 = triangles[i].v0[a];
+            double v1 = v0 + triangles[i].e1[a];
+            double v2 = v0 + triangles[i].e2[a];
+            lo[a] = fmin(v0, fmin(v1, v2));
+            hi[a] = fmax(v0, fmax(v1, v2));
+        }
+        break;
+    case PRIMITIVE_RECTANGLE: {
+        // padded along the normal like the rectangle classes
+        const RectanglePrimitive& rect = rectangles[i];
+        int a = (rect.axis == 0) ? 1 : 0;
+        int b = (rect.axis == 2) ? 1 : 2;
+        lo[a] = rect.a0; hi[a] = rect.a1;
+        lo[b] = rect.b0; hi[b] = rect.b1;
+        lo[rect.axis] = rect.k - 0.0001;
+        hi[rect.axis] = rect.k + 0.0001;
+        break;
+    }
+    case PRIMITIVE_BOX:
+        for (int a = 0; a < 3; a++) {
+            lo[a] = boxes[i].box_min[a];
+            hi[a] = boxes[i].box_max[a];
+        }
+        break;
+    default: {
+        BoundingBox box;
+        if (!hittables[i]->bounding_box(0, 0, box))
+            std::cerr << "No bounding box in Scene::build.\n";
+        for (int a = 0; a < 3; a++) {
+            lo[a] = box.min()[a];
+            hi[a] = box.max()[a];
+        }
+        break;
+    }
+    }
+}
+
+template <typename T>
+void Scene::reorder(std::vector<T>& items, const std::vector<uint32_t>& order) {
+    std::vector<T> sorted;
+    sorted.reserve(order.size());
+    for (uint32_t i : order) sorted.push_back(items[i]);
+    items.swap(sorted);
+}
+
+void Scene::build(const BVHBuildOptions& build_options) {
+    bvh = BVHN<3>();
+
+    size_t counts[PRIMITIVE_TYPES] = { spheres.size(), triangles.size(), rectangles.size(), boxes.size(), hittables.size() };
+    std::vector<BVHBuildPrimitive<3>> prims;
+    prims.reserve(primitive_count());
+    for (int type = 0; type < PRIMITIVE_TYPES; type++) {
+        if (counts[type] > INDEX_MASK)
+            std::cerr << "Too many primitives of one type in Scene::build.\n";
+        for (size_t i = 0; i < counts[type]; i++) {
+            BVHBuildPrimitive<3> p;
+            primitive_bounds((PrimitiveType)type, i, p.box.lo, p.box.hi);
+            for (int a = 0; a < 3; a++) {
+                p.centroid[a] = 0.5 * (p.box.lo[a] + p.box.hi[a]);
+            }
+            p.index = (uint32_t)i;
+            p.group = (uint32_t)type;
+            prims.push_back(p);
+        }
+    }
+    if (prims.empty()) return;
+
+    bvh = BVHN<3>(prims, build_options);
+
+    // every leaf becomes a contiguous range of its type's array, prims is in leaf order
+    std::vector<uint32_t> order[PRIMITIVE_TYPES];
+    for (size_t i = 0; i < prims.size(); i++) {
+        uint32_t type = prims[i].group;
+        bvh.prims[i] = (type << TYPE_SHIFT) | (uint32_t)order[type].size();
+        order[type].push_back(prims[i].index);
+    }
+
+    reorder(spheres, order[PRIMITIVE_SPHERE]);
+    reorder(triangles, order[PRIMITIVE_TRIANGLE]);
+    reorder(rectangles, order[PRIMITIVE_RECTANGLE]);
+    reorder(boxes, order[PRIMITIVE_BOX]);
+    reorder(hittables, order[PRIMITIVE_HITTABLE]);
+}
+
+bool Scene::bounding_box(double t0, double t1, BoundingBox& output_box) const {
+    double lo[3], hi[3];
+    if (!bvh.bounds(lo, hi)) return false;
+    output_box = BoundingBox(Point3(lo[0], lo[1], lo[2]), Point3(hi[0], hi[1], hi[2]));
+    return true;
+}
+
+// the one type dispatch per leaf, the loops inside are over a single array
+bool Scene::hit_leaf(const uint32_t* prims, int count, const Ray& r, double tmin, double tmax, hit_record& rec) const {
+    bool hit_anything = false;
+    double closest_so_far = tmax;
+    uint32_t first = prims[0] & INDEX_MASK;
+    uint32_t last = first + (uint32_t)count;
+
+    switch (prims[0] >> TYPE_SHIFT) {
+    case PRIMITIVE_SPHERE:
+        for (uint32_t i = first; i < last; i++) {
+            if (hit_sphere(spheres[i], r, tmin, closest_so_far, rec)) { hit_anything = true; closest_so_far = rec.t; }
+        }
+        break;
+    case PRIMITIVE_TRIANGLE:
+        for (uint32_t i = first; i < last; i++) {
+            if (hit_triangle(triangles[i], r, tmin, closest_so_far, rec)) { hit_anything = true; closest_so_far = rec.t; }
+        }
+        break;
+    case PRIMITIVE_RECTANGLE:
+        for (uint32_t i = first; i < last; i++) {
+            if (hit_rectangle(rectangles[i], r, tmin, closest_so_far, rec)) { hit_anything = true; closest_so_far = rec.t; }
+        }
+        break;
+    case PRIMITIVE_BOX:
+        for (uint32_t i = first; i < last; i++) {
+            if (hit_box(boxes[i], r, tmin, closest_so_far, rec)) { hit_anything = true; closest_so_far = rec.t; }
+        }
+        break;
+    default:
+        for (uint32_t i = first; i < last; i++) {
+            if (hittables[i]->hit(r, tmin, closest_so_far, rec)) { hit_anything = true; closest_so_far = rec.t; }
+        }
+        break;
+    }
+    return hit_anything;
+}
+
+bool Scene::hit(const Ray& r, double tmin, double tmax, hit_record& rec) const {
+    float origin[3], dir[3];
+    for (int a = 0; a < 3; a++) {
+        origin[a] = (float)r.origin()[a];
+        dir[a] = (float)r.direction()[a];
+    }
+
+    // the boxes are tested in float like LinearBVH, the primitives keep the double interval
+    double closest_so_far = tmax;
+    TRACE_STAT(TraceStats& stats = thread_trace_stats());
+    return bvh.traverse<ClosestHitQuery>(origin, dir, float_down(tmin), float_up(tmax),
+        [&](const uint32_t* prims, int count, float, float& box_tmax) {
+            TRACE_STAT(stats.primitive_tests += count);
+            if (!hit_leaf(prims, count, r, tmin, closest_so_far, rec)) return false;
+            closest_so_far = rec.t;
+            box_tmax = float_up(closest_so_far);
+            return true;
+        });
+}
+
+#endif
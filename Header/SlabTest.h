@@ -0,0 +1,179 @@
+#ifndef SLABTEST_H
+#define SLABTEST_H
+
+// float ray/box slab tests for the innermost BVH loops. the ray is prepared once per
+// traversal (inverse direction, sign bits), so a box test is only subtract, multiply and
+// min/max. with SSE one call tests a ray against four 3D boxes, or against one 4D box.
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SLAB_SSE
+#include <emmintrin.h>
+#endif
+
+// ray for slab_test4, every value is repeated in the four lanes
+struct alignas(16) SlabRay {
+    float origin[3][4];
+    float inv_dir[3][4];
+    int sign[3];        // 1 where the direction is negative, picks the plane the ray enters first
+};
+
+inline SlabRay prepare_slab_ray(const double origin[3], const double dir[3]) {
+    SlabRay ray;
+    for (int a = 0; a < 3; a++) {
+        float inv = (float)(1.0 / dir[a]);
+        for (int lane = 0; lane < 4; lane++) {
+            ray.origin[a][lane] = (float)origin[a];
+            ray.inv_dir[a][lane] = inv;
+        }
+        ray.sign[a] = inv < 0;
+    }
+    return ray;
+}
+
+// four boxes side by side: bounds[0] holds the minima and bounds[1] the maxima, per axis,
+// one box per lane. unused lanes get min = +inf and max = -inf and never hit
+struct alignas(16) SlabBoxes4 {
+    float bounds[2][3][4];
+};
+
+// bit i is set when the ray enters box i within [tmin, tmax], t_near[i] is where it enters
+inline int slab_test4(const SlabBoxes4& boxes, const SlabRay& ray, float tmin, float tmax, float t_near[4]) {
+#ifdef SLAB_SSE
+    __m128 t0 = _mm_set1_ps(tmin);
+    __m128 t1 = _mm_set1_ps(tmax);
+    for (int a = 0; a < 3; a++) {
+        __m128 o = _mm_load_ps(ray.origin[a]);
+        __m128 inv = _mm_load_ps(ray.inv_dir[a]);
+        __m128 near_plane = _mm_load_ps(boxes.bounds[ray.sign[a]][a]);
+        __m128 far_plane = _mm_load_ps(boxes.bounds[1 - ray.sign[a]][a]);
+        // the computed value goes first so a NaN (0 * inf) keeps the current interval
+        t0 = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(near_plane, o), inv), t0);
+        t1 = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(far_plane, o), inv), t1);
+    }
+    _mm_storeu_ps(t_near, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+#else
+    int mask = 0;
+    for (int lane = 0; lane < 4; lane++) {
+        float t0 = tmin;
+        float t1 = tmax;
+        for (int a = 0; a < 3; a++) {
+            float t_enter = (boxes.bounds[ray.sign[a]][a][lane] - ray.origin[a][lane]) * ray.inv_dir[a][lane];
+            float t_exit = (boxes.bounds[1 - ray.sign[a]][a][lane] - ray.origin[a][lane]) * ray.inv_dir[a][lane];
+            t0 = t_enter > t0 ? t_enter : t0;
+            t1 = t_exit < t1 ? t_exit : t1;
+        }
+        t_near[lane] = t0;
+        if (t0 <= t1) mask |= 1 << lane;
+    }
+    return mask;
+#endif
+}
+
+// 4D ray, one axis per lane
+struct alignas(16) SlabRay4D {
+    float origin[4];
+    float inv_dir[4];
+    int sign[4];
+};
+
+inline SlabRay4D prepare_slab_ray_4d(const float origin[4], const float dir[4]) {
+    SlabRay4D ray;
+    for (int a = 0; a < 4; a++) {
+        ray.origin[a] = origin[a];
+        ray.inv_dir[a] = 1.0f / dir[a];
+        ray.sign[a] = ray.inv_dir[a] < 0;
+    }
+    return ray;
+}
+
+// one 3D box in the first three lanes of a 4D ray. lo and hi are loaded four floats at a
+// time, so each has to be followed by one more readable float (BVHNodeN<3> is laid out so)
+inline bool slab_test_3d(const float lo[3], const float hi[3], const SlabRay4D& ray, float tmin, float tmax, float& t_near) {
+#ifdef SLAB_SSE
+    __m128 o = _mm_load_ps(ray.origin);
+    __m128 inv = _mm_load_ps(ray.inv_dir);
+    // the fourth float is hi[0] or the node's offset, an integer that reads as a denormal and
+    // would slow down every operation on it. zeroed right away, then replaced by tmin/tmax
+    __m128 xyz = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    __m128 box_lo = _mm_and_ps(xyz, _mm_loadu_ps(lo));
+    __m128 box_hi = _mm_and_ps(xyz, _mm_loadu_ps(hi));
+
+    __m128 negative = _mm_cmplt_ps(inv, _mm_setzero_ps());
+    __m128 near_plane = _mm_or_ps(_mm_and_ps(negative, box_hi), _mm_andnot_ps(negative, box_lo));
+    __m128 far_plane = _mm_or_ps(_mm_and_ps(negative, box_lo), _mm_andnot_ps(negative, box_hi));
+
+    __m128 t_lo = _mm_set1_ps(tmin);
+    __m128 t_hi = _mm_set1_ps(tmax);
+    __m128 t0 = _mm_max_ps(_mm_or_ps(_mm_and_ps(xyz, _mm_mul_ps(_mm_sub_ps(near_plane, o), inv)), _mm_andnot_ps(xyz, t_lo)), t_lo);
+    __m128 t1 = _mm_min_ps(_mm_or_ps(_mm_and_ps(xyz, _mm_mul_ps(_mm_sub_ps(far_plane, o), inv)), _mm_andnot_ps(xyz, t_hi)), t_hi);
+
+    t0 = _mm_max_ps(t0, _mm_shuffle_ps(t0, t0, _MM_SHUFFLE(2, 3, 0, 1)));
+    t0 = _mm_max_ps(t0, _mm_shuffle_ps(t0, t0, _MM_SHUFFLE(1, 0, 3, 2)));
+    t1 = _mm_min_ps(t1, _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(2, 3, 0, 1)));
+    t1 = _mm_min_ps(t1, _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    float t_enter = _mm_cvtss_f32(t0);
+    float t_exit = _mm_cvtss_f32(t1);
+#else
+    float t_enter = tmin;
+    float t_exit = tmax;
+    for (int a = 0; a < 3; a++) {
+        float near_plane = ray.sign[a] ? hi[a] : lo[a];
+        float far_plane = ray.sign[a] ? lo[a] : hi[a];
+        float tn = (near_plane - ray.origin[a]) * ray.inv_dir[a];
+        float tf = (far_plane - ray.origin[a]) * ray.inv_dir[a];
+        t_enter = tn > t_enter ? tn : t_enter;
+        t_exit = tf < t_exit ? tf : t_exit;
+    }
+#endif
+    t_near = t_enter;
+    return t_enter <= t_exit;
+}
+
+// one 4D box, the four axes are handled together in one register
+inline bool slab_test_4d(const float lo[4], const float hi[4], const SlabRay4D& ray, float tmin, float tmax, float& t_near) {
+#ifdef SLAB_SSE
+    __m128 o = _mm_load_ps(ray.origin);
+    __m128 inv = _mm_load_ps(ray.inv_dir);
+    __m128 box_lo = _mm_loadu_ps(lo);
+    __m128 box_hi = _mm_loadu_ps(hi);
+
+    // near and far planes picked by the sign like slab_test4, not by min/max of the two
+    // distances: with a zero direction an origin on a plane gives 0 * inf = NaN
+    __m128 negative = _mm_cmplt_ps(inv, _mm_setzero_ps());
+    __m128 near_plane = _mm_or_ps(_mm_and_ps(negative, box_hi), _mm_andnot_ps(negative, box_lo));
+    __m128 far_plane = _mm_or_ps(_mm_and_ps(negative, box_lo), _mm_andnot_ps(negative, box_hi));
+
+    // the computed value goes first so a NaN lane keeps the current interval
+    __m128 t0 = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(near_plane, o), inv), _mm_set1_ps(tmin));
+    __m128 t1 = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(far_plane, o), inv), _mm_set1_ps(tmax));
+
+    // horizontal max of the entries and min of the exits
+    t0 = _mm_max_ps(t0, _mm_shuffle_ps(t0, t0, _MM_SHUFFLE(2, 3, 0, 1)));
+    t0 = _mm_max_ps(t0, _mm_shuffle_ps(t0, t0, _MM_SHUFFLE(1, 0, 3, 2)));
+    t1 = _mm_min_ps(t1, _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(2, 3, 0, 1)));
+    t1 = _mm_min_ps(t1, _mm_shuffle_ps(t1, t1, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    float t_enter = _mm_cvtss_f32(t0);
+    float t_exit = _mm_cvtss_f32(t1);
+#else
+    float t_enter = tmin;
+    float t_exit = tmax;
+    for (int a = 0; a < 4; a++) {
+        float near_plane = ray.sign[a] ? hi[a] : lo[a];
+        float far_plane = ray.sign[a] ? lo[a] : hi[a];
+        float tn = (near_plane - ray.origin[a]) * ray.inv_dir[a];
+        float tf = (far_plane - ray.origin[a]) * ray.inv_dir[a];
+        t_enter = tn > t_enter ? tn : t_enter;
+        t_exit = tf < t_exit ? tf : t_exit;
+    }
+#endif
+    t_near = t_enter;
+    return t_enter <= t_exit;
+}
+
+#endif
@@ -7,7 +7,7 @@
 class Sphere : public Hittable {
     public:
         Sphere() {}
-        Sphere(Point3 cen, double r, shared_ptr<Material> m) : center(cen), radius(r), mat_ptr(m){};
+        Sphere(Point3 cen, double r, uint32_t m) : center(cen), radius(r), material_id(m){};
 
         virtual bool hit(
             const Ray& r, double tmin, double tmax, hit_record& rec) const override;
@@ -16,7 +16,7 @@ class Sphere : public Hittable {
     private:
         Point3 center;
         double radius; 
-        shared_ptr<Material> mat_ptr;
+        uint32_t material_id;
 };
 
 bool Sphere::hit(const Ray& r, double t_min, double t_max, hit_record& rec) const {
@@ -36,7 +36,7 @@ bool Sphere::hit(const Ray& r, double t_min, double t_max, hit_record& rec) cons
             rec.p = r.at(rec.t);
             vec3 outward_normal = (rec.p - center) / radius;
             rec.set_face_normal(r, outward_normal);
-            rec.material_ptr = mat_ptr;
+            rec.material_id = material_id;
             return true;
         }
 
@@ -46,7 +46,7 @@ bool Sphere::hit(const Ray& r, double t_min, double t_max, hit_record& rec) cons
             rec.p = r.at(rec.t);
             vec3 outward_normal = (rec.p - center) / radius;
             rec.set_face_normal(r, outward_normal);
-            rec.material_ptr = mat_ptr;
+            rec.material_id = material_id;
             return true;
         }
     }
@@ -0,0 +1,156 @@
+#ifndef TETGENLOADER_H
+#define TETGENLOADER_H
+
+// TetGen .node/.ele files with a fourth coordinate, read straight into a TetraMesh.
+//   .node  "<points> <dimension 3|4> <attributes> <boundary marker 0|1>", then one
+//          "<id> x y z [w] [attributes] [marker]" line per point, a missing w is 0
+//   .ele   "<tetrahedra> <nodes per tetrahedron 4|10> <region attribute 0|1>", then one
+//          "<id> n0 n1 n2 n3 [...]" line per tetrahedron, only the corners are used
+// '#' starts a comment. ids start at 0 or 1, whatever the first point uses.
+// the files are mapped and cut into line aligned chunks that are parsed in parallel. every
+// record goes to the slot its id names, so the chunks need no line numbers; a slot nobody
+// filled (a missing or repeated id) is an error, as is an index outside the points.
+
+#include "TetraMesh.h"
+#include "MappedFile.h"
+#include "TextScan.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+// runs parse(chunk_begin, chunk_end, error) on line aligned chunks of [begin, end),
+// false with the first error
+template <typename Parse>
+bool tetgen_parse_chunks(const char* begin, const char* end, int threads, const std::string& filename, Parse parse) {
+    int parts = scan_chunk_count(end - begin, threads);
+    std::vector<const char*> cuts = scan_line_chunks(begin, end, parts);
+    std::string error = scan_parallel(parts, [&](int i, std::string& chunk_error) {
+        parse(cuts[i], cuts[i + 1], chunk_error);
+    });
+    if (!error.empty()) {
+        std::cerr << "TetGen: " << filename << ": " << error << "\n";
+        return false;
+    }
+    return true;
+}
+
+// reads node_file and ele_file into mesh (vertices, vertIndex, vols, no AO).
+// threads = 0 uses every core. false with a message on the first problem, mesh is then
+// left in an unspecified state
+bool load_tetgen(const std::string& node_file, const std::string& ele_file, TetraMesh& mesh, int threads = 0) {
+    MappedFile nodes, eles;
+    if (!nodes.open(node_file) || !eles.open(ele_file)) return false;
+
+    // .node header and the id base from the first point
+    const char* p = nodes.data();
+    const char* end = p + nodes.size();
+    long long points, dimension, attributes, markers = 0;
+    if (!scan_next_record(p, end) || !scan_int(p, end, points) || !scan_int(p, end, dimension) ||
+        !scan_int(p, end, attributes) || points < 0 || points > std::numeric_limits<int>::max() ||
+        (dimension != 3 && dimension != 4) || attributes < 0) {
+        std::cerr << "TetGen: " << node_file << ": bad header\n";
+        return false;
+    }
+    scan_int(p, end, markers);
+    scan_skip_line(p, end);
+
+    const char* q = p;
+    long long base = 0;
+    if (points > 0 && (!scan_next_record(q, end) || !scan_int(q, end, base) || base < 0 || base > 1)) {
+        std::cerr << "TetGen: " << node_file << ": the first point id has to be 0 or 1\n";
+        return false;
+    }
+
+    // NaN marks a point nobody wrote, coordinates are never NaN
+    const float unset = std::numeric_limits<float>::quiet_NaN();
+    mesh.vertices.assign((size_t)points, float4(unset, unset, unset, unset));
+    mesh.ao_values.clear();
+
+    bool ok = tetgen_parse_chunks(p, end, threads, node_file, [&](const char* c, const char* c_end, std::string& error) {
+        while (scan_next_record(c, c_end)) {
+            const char* line = c;
+            long long id;
+            cl_float4 v = float4(0.0f, 0.0f, 0.0f, 0.0f);
+            bool parsed = scan_int(c, c_end, id);
+            for (int a = 0; parsed && a < dimension; a++) parsed = scan_float(c, c_end, v.s[a]);
+            if (!parsed) {
+                error = "cannot read point line \"" + std::string(line, std::find(line, c_end, '\n')) + "\"";
+                return;
+            }
+            if (id - base < 0 || id - base >= points) {
+                error = "point id " + std::to_string(id) + " out of range";
+                return;
+            }
+            mesh.vertices[id - base] = v;
+            scan_skip_line(c, c_end);
+        }
+    });
+    if (!ok) return false;
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        if (std::isnan(mesh.vertices[i].s[0])) {
+            std::cerr << "TetGen: " << node_file << ": point " << i + base << " is missing or not a number\n";
+            return false;
+        }
+    }
+
+    // .ele header
+    p = eles.data();
+    end = p + eles.size();
+    long long tetras, corners, region = 0;
+    if (!scan_next_record(p, end) || !scan_int(p, end, tetras) || !scan_int(p, end, corners) ||
+        tetras < 0 || tetras > std::numeric_limits<int>::max() / 4 || (corners != 4 && corners != 10)) {
+        std::cerr << "TetGen: " << ele_file << ": bad header\n";
+        return false;
+    }
+    scan_int(p, end, region);
+    scan_skip_line(p, end);
+
+    // -1 marks a tetrahedron nobody wrote
+    mesh.vols = (int)tetras;
+    mesh.vertIndex.assign((size_t)tetras * 4, -1);
+
+    ok = tetgen_parse_chunks(p, end, threads, ele_file, [&](const char* c, const char* c_end, std::string& error) {
+        while (scan_next_record(c, c_end)) {
+            const char* line = c;
+            long long id, corner[4];
+            bool parsed = scan_int(c, c_end, id);
+            for (int k = 0; parsed && k < 4; k++) parsed = scan_int(c, c_end, corner[k]);
+            if (!parsed) {
+                error = "cannot read tetrahedron line \"" + std::string(line, std::find(line, c_end, '\n')) + "\"";
+                return;
+            }
+            if (id - base < 0 || id - base >= tetras) {
+                error = "tetrahedron id " + std::to_string(id) + " out of range";
+                return;
+            }
+            for (int k = 0; k < 4; k++) {
+                if (corner[k] - base < 0 || corner[k] - base >= points) {
+                    error = "tetrahedron " + std::to_string(id) + " uses point " + std::to_string(corner[k]) +
+                            ", there are " + std::to_string(points);
+                    return;
+                }
+                mesh.vertIndex[(id - base) * 4 + k] = (int)(corner[k] - base);
+            }
+            scan_skip_line(c, c_end);
+        }
+    });
+    if (!ok) return false;
+    for (int i = 0; i < mesh.vols; i++) {
+        if (mesh.vertIndex[i * 4] < 0) {
+            std::cerr << "TetGen: " << ele_file << ": tetrahedron " << i + base << " is missing\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// basename.node and basename.ele
+bool load_tetgen(const std::string& basename, TetraMesh& mesh, int threads = 0) {
+    return load_tetgen(basename + ".node", basename + ".ele", mesh, threads);
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef TETRABVH_H
+#define TETRABVH_H
+
+#include "TetraMesh.h"
+#include "BVHN.h"
+
+// BVH over the tetrahedra of a TetraMesh, the 4D instance of BVHN. the leaves are tested
+// with the 4 wide tetrahedron batch.
+class TetraBVH {
+public:
+    TetraBVH() {}
+    TetraBVH(const TetraMeshView& mesh, const BVHBuildOptions& build_options = BVHBuildOptions());
+
+    // traversal for one Query (see HitQuery.h). the boxes are always clipped to [tmin, tmax],
+    // the tetrahedra only when the query asks for it. any-hit queries stop at the first hit
+    template <typename Query>
+    bool intersect(const TetraRay& ray, const TetraMeshView& mesh, TetraHit& hit,
+                   float tmin = -1e20f, float tmax = 1e20f) const;
+
+    // closest tetrahedron hit with t in [tmin, tmax]. the defaults accept the whole line,
+    // like the brute force intersect_mesh
+    bool intersect(const TetraRay& ray, const TetraMeshView& mesh, int& tetraIndex, float& t,
+                   float tmin = -1e20f, float tmax = 1e20f) const {
+        TetraHit hit;
+        if (!intersect<ShadingQuery>(ray, mesh, hit, tmin, tmax)) return false;
+        tetraIndex = hit.tetra;
+        t = hit.t;
+        return true;
+    }
+
+    // SAH cost of the finished tree, to compare builds
+    double expected_cost() const { return bvh.expected_cost(); }
+
+    size_t node_count() const { return bvh.node_count(); }
+
+public:
+    BVHN<4> bvh;    // bvh.prims are tetra indices
+};
+
+TetraBVH::TetraBVH(const TetraMeshView& mesh, const BVHBuildOptions& build_options) {
+    if (mesh.vols <= 0) return;
+
+    std::vector<BVHBuildPrimitive<4>> prims(mesh.vols);
+    for (int i = 0; i < mesh.vols; i++) {
+        BVHBuildPrimitive<4>& p = prims[i];
+        for (int j = 0; j < 4; j++) {
+            const cl_float4& v = mesh.vertices[mesh.vertIndex[j + i * 4]];
+            double point[4] = { v.s[0], v.s[1], v.s[2], v.s[3] };
+            p.box.grow(point);
+        }
+        for (int a = 0; a < 4; a++) {
+            p.centroid[a] = 0.5 * (p.box.lo[a] + p.box.hi[a]);
+        }
+        p.index = i;
+    }
+
+    bvh = BVHN<4>(prims, build_options);
+}
+
+template <typename Query>
+bool TetraBVH::intersect(const TetraRay& ray, const TetraMeshView& mesh, TetraHit& hit, float tmin, float tmax) const {
+    bool hit_anything = false;
+    TRACE_STAT(TraceStats& stats = thread_trace_stats());
+
+    return bvh.traverse<Query>(ray.origin.s, ray.dir.s, tmin, tmax,
+        [&](const uint32_t* tetras, int count, float t_min, float& closest_so_far) {
+            bool leaf_hit = false;
+#ifdef TRACE_DOUBLE
+            for (int i = 0; i < count; i++) {
+                int tetra = (int)tetras[i];
+                TRACE_STAT(stats.primitive_tests++);
+                TetraHit candidate;
+                bool tetra_hit = intersect_tetrahedron<Query>(mesh.vertices[mesh.vertIndex[0 + tetra * 4]], mesh.vertices[mesh.vertIndex[1 + tetra * 4]],
+                                                              mesh.vertices[mesh.vertIndex[2 + tetra * 4]], mesh.vertices[mesh.vertIndex[3 + tetra * 4]],
+                                                              ray, t_min, closest_so_far, candidate);
+                if (tetra_hit && (Query::any_hit || !hit_anything || candidate.t < hit.t)) {
+                    hit = candidate;
+                    hit.tetra = tetra;
+                    hit_anything = leaf_hit = true;
+                    if (Query::any_hit) return true;
+                    if (Query::clip_interval) closest_so_far = hit.t;
+                }
+            }
+#else
+            // the leaf's tetrahedra four at a time
+            for (int i = 0; i < count; i += 4) {
+                TetraBatch4 batch;
+                gather_tetrahedra4(mesh, tetras + i, std::min(4, count - i), batch);
+                TRACE_STAT(stats.primitive_tests += batch.count);
+                TetraHit candidates[4];
+                int mask = intersect_tetrahedra4<Query>(batch, ray, t_min, closest_so_far, candidates);
+                for (int lane = 0; lane < batch.count; lane++) {
+                    if (!(mask & (1 << lane))) continue;
+                    if (!Query::any_hit && hit_anything && candidates[lane].t >= hit.t) continue;
+                    hit = candidates[lane];
+                    hit.tetra = (int)tetras[i + lane];
+                    hit_anything = leaf_hit = true;
+                    if (Query::any_hit) return true;
+                    if (Query::clip_interval) closest_so_far = hit.t;
+                }
+            }
+#endif
+            return leaf_hit;
+        });
+}
+
+#endif
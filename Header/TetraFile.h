@@ -0,0 +1,331 @@
+#ifndef TETRAFILE_H
+#define TETRAFILE_H
+
+// binary TetraMesh file: a 128 byte header followed by sections of raw little endian arrays,
+// each starting on a 64 byte boundary. a loader maps the file and uses the arrays where they
+// are, nothing is parsed and the BVH does not have to be rebuilt.
+//   vertices        vertex_count cl_float4
+//   indices         tetra_count * 4 int32, into the vertices
+//   ao              vertex_count float                          optional
+//   bvh nodes       node_count BVHNodeN<4> (TetraBVH)           optional
+//   bvh prims       tetra_count uint32, tetra of each leaf slot optional, with the nodes
+//   tetra vertices  tetra_count * 4 cl_float4, gatherTetraVertices for the kernels, optional
+// the version goes up whenever a layout changes, old files are rejected, not misread.
+
+#include "TetraMesh.h"
+#include "TetraBVH.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+const uint32_t TETRA_FILE_VERSION = 1;
+const uint64_t TETRA_FILE_ALIGNMENT = 64;
+
+enum TetraFileSection {
+    TETRA_SECTION_VERTICES,
+    TETRA_SECTION_INDICES,
+    TETRA_SECTION_AO,
+    TETRA_SECTION_BVH_NODES,
+    TETRA_SECTION_BVH_PRIMS,
+    TETRA_SECTION_TETRA_VERTICES,
+    TETRA_SECTION_COUNT
+};
+
+struct TetraFileHeader {
+    char magic[4];          // "TET4"
+    uint32_t version;
+    uint32_t vertex_count;
+    uint32_t tetra_count;
+    uint32_t node_count;    // 0 without a BVH
+    uint32_t pad;
+    double sah_cost;        // TetraBVH::expected_cost of the stored tree
+    uint64_t offset[TETRA_SECTION_COUNT];   // from the start of the file, 0 for a missing section
+    uint64_t size[TETRA_SECTION_COUNT];     // in bytes
+};
+
+static_assert(sizeof(TetraFileHeader) <= 128, "TetraFileHeader has to fit the first 128 bytes");
+static_assert(sizeof(cl_float4) == 16, "vertices are stored as four packed floats");
+static_assert(sizeof(BVHNodeN<4>) == 40, "BVH nodes are stored as they are in memory");
+
+// the arrays are written as they are in memory, so only little endian hosts can share them
+inline bool host_is_little_endian() {
+    const uint32_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+// writes mesh (with its AO when it has some), bvh when it is not null and the flattened
+// tetra vertices when tetra_vertices is set. false when the mesh is inconsistent or the
+// file cannot be written
+bool save_tetra_file(const std::string& filename, const TetraMeshView& mesh, const TetraBVH* bvh = nullptr, bool tetra_vertices = false) {
+    if (!host_is_little_endian()) {
+        std::cerr << "TetraFile: only little endian hosts can write tetra files\n";
+        return false;
+    }
+    if (mesh.vols < 0 || mesh.vertex_count < 0) {
+        std::cerr << "TetraFile: negative vertex or tetrahedron count\n";
+        return false;
+    }
+    for (size_t i = 0; i < (size_t)mesh.vols * 4; i++) {
+        if (mesh.vertIndex[i] < 0 || mesh.vertIndex[i] >= mesh.vertex_count) {
+            std::cerr << "TetraFile: vertex index " << mesh.vertIndex[i] << " out of range\n";
+            return false;
+        }
+    }
+    if (bvh && bvh->bvh.prims.size() != (size_t)mesh.vols) {
+        std::cerr << "TetraFile: the BVH does not belong to this mesh\n";
+        return false;
+    }
+
+    std::vector<cl_float4> gathered;
+    const cl_float4* flat = mesh.tetra_vertices;
+    if (tetra_vertices && !flat) {
+        gathered.resize((size_t)mesh.vols * 4);
+        for (size_t i = 0; i < gathered.size(); i++) gathered[i] = mesh.vertices[mesh.vertIndex[i]];
+        flat = gathered.data();
+    }
+
+    const void* section_data[TETRA_SECTION_COUNT] = {};
+    uint64_t section_size[TETRA_SECTION_COUNT] = {};
+    section_data[TETRA_SECTION_VERTICES] = mesh.vertices;
+    section_size[TETRA_SECTION_VERTICES] = (uint64_t)mesh.vertex_count * sizeof(cl_float4);
+    section_data[TETRA_SECTION_INDICES] = mesh.vertIndex;
+    section_size[TETRA_SECTION_INDICES] = (uint64_t)mesh.vols * 4 * sizeof(int);
+    if (mesh.ao_values && mesh.vertex_count > 0) {
+        section_data[TETRA_SECTION_AO] = mesh.ao_values;
+        section_size[TETRA_SECTION_AO] = (uint64_t)mesh.vertex_count * sizeof(float);
+    }
+    if (bvh && !bvh->bvh.nodes.empty()) {
+        section_data[TETRA_SECTION_BVH_NODES] = bvh->bvh.nodes.data();
+        section_size[TETRA_SECTION_BVH_NODES] = bvh->bvh.nodes.size() * sizeof(BVHNodeN<4>);
+        section_data[TETRA_SECTION_BVH_PRIMS] = bvh->bvh.prims.data();
+        section_size[TETRA_SECTION_BVH_PRIMS] = bvh->bvh.prims.size() * sizeof(uint32_t);
+    }
+    if (tetra_vertices && mesh.vols > 0) {
+        section_data[TETRA_SECTION_TETRA_VERTICES] = flat;
+        section_size[TETRA_SECTION_TETRA_VERTICES] = (uint64_t)mesh.vols * 4 * sizeof(cl_float4);
+    }
+
+    TetraFileHeader header = {};
+    std::memcpy(header.magic, "TET4", 4);
+    header.version = TETRA_FILE_VERSION;
+    header.vertex_count = (uint32_t)mesh.vertex_count;
+    header.tetra_count = (uint32_t)mesh.vols;
+    header.node_count = section_size[TETRA_SECTION_BVH_NODES] ? (uint32_t)bvh->bvh.nodes.size() : 0;
+    header.sah_cost = bvh ? bvh->expected_cost() : 0.0;
+
+    uint64_t end = 128;
+    for (int s = 0; s < TETRA_SECTION_COUNT; s++) {
+        if (!section_data[s]) continue;
+        end = (end + TETRA_FILE_ALIGNMENT - 1) / TETRA_FILE_ALIGNMENT * TETRA_FILE_ALIGNMENT;
+        header.offset[s] = end;
+        header.size[s] = section_size[s];
+        end += section_size[s];
+    }
+
+    std::ofstream file(filename, std::ios::out | std::ios::binary);
+    if (!file) {
+        std::cerr << "Cannot open " << filename << "\n";
+        return false;
+    }
+    const char zeros[128] = {};
+    file.write((const char*)&header, sizeof(header));
+    file.write(zeros, 128 - sizeof(header));
+    uint64_t written = 128;
+    for (int s = 0; s < TETRA_SECTION_COUNT; s++) {
+        if (!section_data[s]) continue;
+        file.write(zeros, header.offset[s] - written);
+        file.write((const char*)section_data[s], header.size[s]);
+        written = header.offset[s] + header.size[s];
+    }
+    if (!file) {
+        std::cerr << "TetraFile: writing " << filename << " failed\n";
+        return false;
+    }
+    return true;
+}
+
+// a mapped tetra file. the accessors point into the mapping and stay valid while the
+// TetraFile is open, missing optional sections return nullptr
+class TetraFile {
+public:
+    TetraFile() {}
+    explicit TetraFile(const std::string& filename) { open(filename); }
+
+    // maps the file and checks the header, the section bounds and every index in the
+    // sections, so a damaged file is rejected here and not read out of bounds later
+    bool open(const std::string& filename);
+    void close() { file.close(); header = nullptr; }
+    bool is_open() const { return header != nullptr; }
+
+    int vertex_count() const { return (int)header->vertex_count; }
+    int tetra_count() const { return (int)header->tetra_count; }
+
+    const cl_float4* vertices() const { return (const cl_float4*)section(TETRA_SECTION_VERTICES); }
+    const int* vert_index() const { return (const int*)section(TETRA_SECTION_INDICES); }
+    const float* ao_values() const { return (const float*)section(TETRA_SECTION_AO); }
+    const BVHNodeN<4>* bvh_nodes() const { return (const BVHNodeN<4>*)section(TETRA_SECTION_BVH_NODES); }
+    const uint32_t* bvh_prims() const { return (const uint32_t*)section(TETRA_SECTION_BVH_PRIMS); }
+    const cl_float4* tetra_vertices() const { return (const cl_float4*)section(TETRA_SECTION_TETRA_VERTICES); }
+
+    // the arrays where they are in the mapping, nothing is copied
+    TetraMeshView view() const;
+    // copies into a TetraMesh that can be changed, a memcpy per array
+    void to_mesh(TetraMesh& mesh) const;
+    // false when the file has no BVH, bvh is then left alone
+    bool to_bvh(TetraBVH& bvh) const;
+
+private:
+    const void* section(int s) const {
+        return header->offset[s] ? file.data() + header->offset[s] : nullptr;
+    }
+
+    // one pass over the indices, prims and nodes of the mapped sections
+    bool check_indices(const TetraFileHeader* h, const std::string& filename) const;
+
+    MappedFile file;
+    const TetraFileHeader* header = nullptr;
+};
+
+bool TetraFile::open(const std::string& filename) {
+    close();
+    if (!file.open(filename)) return false;
+
+    const TetraFileHeader* h = (const TetraFileHeader*)file.data();
+    if (file.size() < 128 || std::memcmp(h->magic, "TET4", 4) != 0) {
+        std::cerr << "TetraFile: " << filename << " is not a tetra file\n";
+        file.close();
+        return false;
+    }
+    if (h->version != TETRA_FILE_VERSION) {
+        std::cerr << "TetraFile: " << filename << " has version " << h->version << ", expected " << TETRA_FILE_VERSION << "\n";
+        file.close();
+        return false;
+    }
+    if (!host_is_little_endian()) {
+        std::cerr << "TetraFile: only little endian hosts can read tetra files\n";
+        file.close();
+        return false;
+    }
+
+    // every section inside the file, aligned and as large as the counts say
+    const uint64_t expected[TETRA_SECTION_COUNT] = {
+        (uint64_t)h->vertex_count * sizeof(cl_float4),
+        (uint64_t)h->tetra_count * 4 * sizeof(int),
+        (uint64_t)h->vertex_count * sizeof(float),
+        (uint64_t)h->node_count * sizeof(BVHNodeN<4>),
+        (uint64_t)h->tetra_count * sizeof(uint32_t),
+        (uint64_t)h->tetra_count * 4 * sizeof(cl_float4)
+    };
+    for (int s = 0; s < TETRA_SECTION_COUNT; s++) {
+        bool required = s == TETRA_SECTION_VERTICES || s == TETRA_SECTION_INDICES;
+        bool present = h->offset[s] != 0;
+        bool bad = present ? (h->offset[s] % TETRA_FILE_ALIGNMENT != 0 || h->size[s] != expected[s] ||
+                              h->offset[s] + h->size[s] > file.size())
+                           : required && expected[s] != 0;
+        if (bad) {
+            std::cerr << "TetraFile: " << filename << " has a damaged section " << s << "\n";
+            file.close();
+            return false;
+        }
+    }
+    if ((h->offset[TETRA_SECTION_BVH_NODES] != 0) != (h->offset[TETRA_SECTION_BVH_PRIMS] != 0)) {
+        std::cerr << "TetraFile: " << filename << " has half a BVH\n";
+        file.close();
+        return false;
+    }
+    if (!check_indices(h, filename)) {
+        file.close();
+        return false;
+    }
+
+    header = h;
+    return true;
+}
+
+bool TetraFile::check_indices(const TetraFileHeader* h, const std::string& filename) const {
+    // the counts are handed out as int
+    if (h->vertex_count > (uint32_t)INT_MAX || h->tetra_count > (uint32_t)INT_MAX) {
+        std::cerr << "TetraFile: " << filename << " has too many vertices or tetrahedra\n";
+        return false;
+    }
+
+    const int* index = (const int*)(file.data() + h->offset[TETRA_SECTION_INDICES]);
+    for (size_t i = 0; i < (size_t)h->tetra_count * 4; i++) {
+        if (index[i] < 0 || (uint32_t)index[i] >= h->vertex_count) {
+            std::cerr << "TetraFile: " << filename << " has vertex index " << index[i] << " out of range\n";
+            return false;
+        }
+    }
+
+    if (!h->offset[TETRA_SECTION_BVH_NODES]) return true;
+
+    const uint32_t* prims = (const uint32_t*)(file.data() + h->offset[TETRA_SECTION_BVH_PRIMS]);
+    for (size_t i = 0; i < h->tetra_count; i++) {
+        if (prims[i] >= h->tetra_count) {
+            std::cerr << "TetraFile: " << filename << " has BVH prim " << prims[i] << " out of range\n";
+            return false;
+        }
+    }
+
+    // children come after their parent, so the depth is known when a node is reached.
+    // BVHN::traverse keeps at most depth nodes on its stack of 64
+    const BVHNodeN<4>* nodes = (const BVHNodeN<4>*)(file.data() + h->offset[TETRA_SECTION_BVH_NODES]);
+    std::vector<uint8_t> depth(h->node_count, 0);
+    for (uint32_t n = 0; n < h->node_count; n++) {
+        const BVHNodeN<4>& node = nodes[n];
+        bool bad = node.count > 0 ? (uint64_t)node.offset + node.count > h->tetra_count
+                                  : node.axis >= 4 || n + 1 >= h->node_count || node.offset <= n ||
+                                    node.offset >= h->node_count || depth[n] + 1 >= 64;
+        if (bad) {
+            std::cerr << "TetraFile: " << filename << " has a damaged BVH node " << n << "\n";
+            return false;
+        }
+        if (node.count == 0) {
+            depth[n + 1] = std::max(depth[n + 1], (uint8_t)(depth[n] + 1));
+            depth[node.offset] = std::max(depth[node.offset], (uint8_t)(depth[n] + 1));
+        }
+    }
+    return true;
+}
+
+TetraMeshView TetraFile::view() const {
+    TetraMeshView mesh;
+    mesh.vertices = vertices();
+    mesh.vertIndex = vert_index();
+    mesh.ao_values = ao_values();
+    mesh.tetra_vertices = tetra_vertices();
+    mesh.vertex_count = vertex_count();
+    mesh.vols = tetra_count();
+    return mesh;
+}
+
+void TetraFile::to_mesh(TetraMesh& mesh) const {
+    const cl_float4* v = vertices();
+    const int* index = vert_index();
+    const float* ao = ao_values();
+    mesh.vertices.assign(v, v + vertex_count());
+    mesh.vertIndex.assign(index, index + (size_t)tetra_count() * 4);
+    mesh.vols = tetra_count();
+    if (ao) mesh.ao_values.assign(ao, ao + vertex_count());
+    else mesh.ao_values.clear();
+}
+
+bool TetraFile::to_bvh(TetraBVH& bvh) const {
+    const BVHNodeN<4>* nodes = bvh_nodes();
+    const uint32_t* prims = bvh_prims();
+    if (!nodes) return false;
+    bvh.bvh.nodes.assign(nodes, nodes + header->node_count);
+    bvh.bvh.prims.assign(prims, prims + tetra_count());
+    bvh.bvh.sah_cost = header->sah_cost;
+    return true;
+}
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef TETRAMESH_H
+#define TETRAMESH_H
+
+// host side of the 4D tetrahedral renderer: mesh layout, cl_float4 math and the
+// ray-tetrahedron test, in the same OpenCL vector types as kernel.cl.
+// TetraRay is the cl_float4 ray of this path, Ray4 (Ray4.h) is the double ray of the CPU renderer.
+// this header and the ones it pulls in stay free of Renderer.h, so the OpenCL host code can
+// use them next to its own vector types
+
+#include <CL/cl.h>
+
+#include "Det4.h"
+#include "HitQuery.h"
+#include "TraceStats.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#ifndef float3
+#define float3(x, y, z) {{x, y, z}}
+#endif
+#ifndef float4
+#define float4(x, y, z, w) {{x, y, z, w}}
+#endif
+
+const float epsilon = 0.00003f;
+
+struct TriangleMesh {
+    std::vector<cl_float3> vertices;
+    std::vector<float> ao_values;
+    int faces;
+    std::vector<int> vertIndex;
+};
+
+struct TetraMesh {
+    std::vector<cl_float4> vertices;
+    std::vector<float> ao_values;
+    int vols;
+    std::vector<int> vertIndex;
+};
+
+// read only view of a mesh without owning it: a TetraMesh, or the arrays of a mapped
+// TetraFile used where they are. the tests and renderers take this, so a mesh file is
+// rendered without copying it
+struct TetraMeshView {
+    const cl_float4* vertices = nullptr;
+    const int* vertIndex = nullptr;
+    const float* ao_values = nullptr;           // one per vertex, nullptr without AO
+    const cl_float4* tetra_vertices = nullptr;  // 4 per tetrahedron like gatherTetraVertices, nullptr when not stored
+    int vertex_count = 0;
+    int vols = 0;
+
+    TetraMeshView() {}
+    TetraMeshView(const TetraMesh& mesh)
+        : vertices(mesh.vertices.data()), vertIndex(mesh.vertIndex.data()),
+          ao_values(!mesh.ao_values.empty() && mesh.ao_values.size() == mesh.vertices.size() ? mesh.ao_values.data() : nullptr),
+          vertex_count((int)mesh.vertices.size()), vols(mesh.vols) {}
+};
+
+struct TetraRay {
+    cl_float4 origin;
+    cl_float4 dir;
+};
+
+cl_float4 normalize(cl_float4 v) {
+    float length = std::sqrt(v.s0*v.s0 + v.s1 * v.s1 + v.s2 * v.s2 + v.s3 * v.s3);
+    return float4(v.s0 / length, v.s1 / length, v.s2 / length, v.s3 / length);
+}
+
+cl_float4 operator-(cl_float4 v, cl_float4 w) {
+    return float4(v.s0 - w.s0, v.s1 - w.s1, v.s2 - w.s2, v.s3 - w.s3);
+}
+
+cl_float4 operator+(cl_float4 v, cl_float4 w) {
+    return float4(v.s0 + w.s0, v.s1 + w.s1, v.s2 + w.s2, v.s3 + w.s3);
+}
+
+cl_float4 operator*(cl_float4 v, float t) {
+    return float4(t * v.s0, t * v.s1, t * v.s2, t * v.s3);
+}
+
+float dot(cl_float4 A, cl_float4 B) {
+    return A.s0 * B.s0 + A.s1 * B.s1 + A.s2 * B.s2 + A.s3 * B.s3;
+}
+
+
+// precision of the host side tetra test. float is what kernel.cl computes, build with
+// TRACE_DOUBLE to check the float results against double
+#ifdef TRACE_DOUBLE
+typedef double trace_real;
+#else
+typedef float trace_real;
+#endif
+
+float det4(cl_float4 A, cl_float4 B, cl_float4 C, cl_float4 D) {
+    return det4<float>(A.s, B.s, C.s, D.s);
+}
+
+cl_float4 cross4(cl_float4 A, cl_float4 B, cl_float4 C) {
+ 
+    float x =   ((A.s1 * B.s2 * C.s3) + (A.s2 * B.s3 * C.s1) + (A.s3 * B.s1 * C.s2) - (C.s1 * B.s2 * A.s3) - (C.s2 * B.s3 * A.s1) - (C.s3 * B.s1 * A.s2));
+    float y = - ((A.s0 * B.s2 * C.s3) + (A.s2 * B.s3 * C.s0) + (A.s3 * B.s0 * C.s2) - (C.s0 * B.s2 * A.s3) - (C.s2 * B.s3 * A.s0) - (C.s3 * B.s0 * A.s2));
+    float z =   ((A.s0 * B.s1 * C.s3) + (A.s1 * B.s3 * C.s0) + (A.s3 * B.s0 * C.s1) - (C.s0 * B.s1 * A.s3) - (C.s1 * B.s3 * A.s0) - (C.s3 * B.s0 * A.s1));
+    float w = - ((A.s0 * B.s1 * C.s2) + (A.s1 * B.s2 * C.s0) + (A.s2 * B.s0 * C.s1) - (C.s0 * B.s1 * A.s2) - (C.s1 * B.s2 * A.s0) - (C.s2 * B.s0 * A.s1));
+    return float4(x, y, z, w);
+}
+
+
+// a tetrahedron hit. bary is only written when the query asks for barycentrics, in the
+// order v0, v1, v2, v3
+struct TetraHit {
+    float t;
+    int tetra;
+    float bary[4];
+};
+
+// the ray-tetrahedron test for one Query (see HitQuery.h), computed in Real
+template <typename Query, typename Real = trace_real>
+bool intersect_tetrahedron(cl_float4 v0, cl_float4 v1, cl_float4 v2, cl_float4 v3, const TetraRay& ray,
+                           float tmin, float tmax, TetraHit& hit) {
+
+    Real dir[4], v0v1[4], v0v2[4], v0v3[4], Tvec[4];
+    for (int a = 0; a < 4; a++) {
+        dir[a] = ray.dir.s[a];
+        v0v1[a] = (Real)v1.s[a] - v0.s[a];
+        v0v2[a] = (Real)v2.s[a] - v0.s[a];
+        v0v3[a] = (Real)v3.s[a] - v0.s[a];
+        Tvec[a] = (Real)ray.origin.s[a] - v0.s[a];
+    }
+
+    Real M[4];
+    Real detM = ray_tetra_cramer(dir, v0v1, v0v2, v0v3, Tvec, M);
+
+    if (Query::cull_backfaces) {
+        if (detM < epsilon) { return false; }
+    }
+    else if (std::fabs(detM) < epsilon) { return false; }
+
+    Real invDet = 1 / detM;
+
+    Real y = M[1] * invDet;
+    Real z = M[2] * invDet;
+    Real w = M[3] * invDet;
+
+    if (y < 0 || z < 0 || w < 0 || y+z+w > 1) { return false; }
+
+    // origin + t*dir = v0 + y*v0v1 + z*v0v2 + w*v0v3, so t picks up a minus sign from Tvec
+    float t = (float)(-M[0] * invDet);
+    if (Query::clip_interval && (t < tmin || t > tmax)) { return false; }
+
+    hit.t = t;
+    if (Query::barycentrics) {
+        hit.bary[0] = (float)(1 - y - z - w);
+        hit.bary[1] = (float)y;
+        hit.bary[2] = (float)z;
+        hit.bary[3] = (float)w;
+    }
+    return true;
+}
+
+// both sides, any t
+template <typename Real>
+bool intersect_tetrahedron(cl_float4 v0, cl_float4 v1, cl_float4 v2, cl_float4 v3, TetraRay ray, float &t) {
+    TetraHit hit;
+    if (!intersect_tetrahedron<HitQuery<false, false, false, false>, Real>(v0, v1, v2, v3, ray, 0, 0, hit)) { return false; }
+    t = hit.t;
+    return true;
+}
+
+bool intersect_tetrahedron(cl_float4 v0, cl_float4 v1, cl_float4 v2, cl_float4 v3, TetraRay ray, float &t) {
+    return intersect_tetrahedron<trace_real>(v0, v1, v2, v3, ray, t);
+}
+
+// up to four tetrahedra side by side for intersect_tetrahedra4: v[vertex][axis][lane].
+// empty lanes stay all zero, a degenerate tetrahedron that is never hit
+struct TetraBatch4 {
+    float v[4][4][4];
+    int count;
+};
+
+inline void gather_tetrahedra4(const TetraMeshView& mesh, const uint32_t* tetras, int count, TetraBatch4& batch) {
+    for (int k = 0; k < 4; k++)
+        for (int a = 0; a < 4; a++)
+            for (int lane = 0; lane < 4; lane++)
+                batch.v[k][a][lane] = lane < count ? mesh.vertices[mesh.vertIndex[k + tetras[lane] * 4]].s[a] : 0.0f;
+    batch.count = count;
+}
+
+// the float test of intersect_tetrahedron<Query> on four tetrahedra at once. bit i of the
+// result is set when tetrahedron i is hit, then hits[i] holds t (and the barycentrics)
+template <typename Query>
+inline int intersect_tetrahedra4(const TetraBatch4& batch, const TetraRay& ray, float tmin, float tmax, TetraHit hits[4]) {
+    Lanes4f dir[4], v0v1[4], v0v2[4], v0v3[4], Tvec[4];
+    for (int a = 0; a < 4; a++) {
+        Lanes4f v0 = Lanes4f::load(batch.v[0][a]);
+        dir[a] = Lanes4f(ray.dir.s[a]);
+        v0v1[a] = Lanes4f::load(batch.v[1][a]) - v0;
+        v0v2[a] = Lanes4f::load(batch.v[2][a]) - v0;
+        v0v3[a] = Lanes4f::load(batch.v[3][a]) - v0;
+        Tvec[a] = Lanes4f(ray.origin.s[a]) - v0;
+    }
+
+    Lanes4f M[4];
+    Lanes4f detM = ray_tetra_cramer(dir, v0v1, v0v2, v0v3, Tvec, M);
+
+    float det[4], num[4][4];
+    detM.store(det);
+    for (int i = 0; i < 4; i++) M[i].store(num[i]);
+
+    int mask = 0;
+    for (int lane = 0; lane < batch.count; lane++) {
+        if (Query::cull_backfaces ? det[lane] < epsilon : std::fabs(det[lane]) < epsilon) continue;
+        float invDet = 1 / det[lane];
+        float y = num[1][lane] * invDet;
+        float z = num[2][lane] * invDet;
+        float w = num[3][lane] * invDet;
+        if (y < 0 || z < 0 || w < 0 || y + z + w > 1) continue;
+        float t = -num[0][lane] * invDet;
+        if (Query::clip_interval && (t < tmin || t > tmax)) continue;
+
+        hits[lane].t = t;
+        if (Query::barycentrics) {
+            hits[lane].bary[0] = 1 - y - z - w;
+            hits[lane].bary[1] = y;
+            hits[lane].bary[2] = z;
+            hits[lane].bary[3] = w;
+        }
+        mask |= 1 << lane;
+        if (Query::any_hit) break;
+    }
+    return mask;
+}
+
+bool intersect_mesh(TetraRay ray, std::vector<cl_float4>vertices, int vol, int* vertIndex, int &tetraIndex) {
+    float t_old = 1e20;
+    float t_new = 1e20;
+    for (int i = 0; i < vol; i++) {
+        cl_float4 v0 = vertices[vertIndex[0 + i*4]];
+        cl_float4 v1 = vertices[vertIndex[1 + i * 4]];
+        cl_float4 v2 = vertices[vertIndex[2 + i * 4]];
+        cl_float4 v3 = vertices[vertIndex[3 + i * 4]];
+
+        
+        bool intersect = intersect_tetrahedron(v0, v1, v2, v3, ray, t_new);
+        //std::cout << "t: " << t << std::endl;
+        if (intersect) {
+            //std::cout << "intersects a tetrahedra!\n";
+            if (t_old > t_new){
+                t_old = t_new;
+                tetraIndex = i;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// brute force over every tetrahedron. any-hit queries return the first hit found, the others
+// the closest one. with clip_interval only hits in [tmin, tmax] count
+template <typename Query>
+bool intersect_mesh(const TetraRay& ray, const TetraMeshView& mesh, TetraHit& hit, float tmin = -1e20f, float tmax = 1e20f) {
+    bool hit_anything = false;
+    float closest_so_far = tmax;
+    TRACE_STAT(TraceStats& stats = thread_trace_stats());
+    TRACE_STAT(stats.rays++);
+    for (int i = 0; i < mesh.vols; i++) {
+        TRACE_STAT(stats.primitive_tests++);
+        cl_float4 v0 = mesh.vertices[mesh.vertIndex[0 + i * 4]];
+        cl_float4 v1 = mesh.vertices[mesh.vertIndex[1 + i * 4]];
+        cl_float4 v2 = mesh.vertices[mesh.vertIndex[2 + i * 4]];
+        cl_float4 v3 = mesh.vertices[mesh.vertIndex[3 + i * 4]];
+
+        TetraHit candidate;
+        if (!intersect_tetrahedron<Query>(v0, v1, v2, v3, ray, tmin, closest_so_far, candidate)) continue;
+        if (!Query::any_hit && hit_anything && candidate.t >= hit.t) continue;
+
+        hit = candidate;
+        hit.tetra = i;
+        hit_anything = true;
+        if (Query::any_hit) break;
+        if (Query::clip_interval) closest_so_far = hit.t;
+    }
+    TRACE_STAT(stats.hits += hit_anything);
+    return hit_anything;
+}
+
+// first tetrahedron hit anywhere on the line
+bool intersect_mesh(TetraRay ray, const TetraMeshView& mesh, int& tetraIndex) {
+    TetraHit hit;
+    if (!intersect_mesh<CoverageQuery>(ray, mesh, hit)) return false;
+    tetraIndex = hit.tetra;
+    return true;
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef TETRAREORDER_H
+#define TETRAREORDER_H
+
+// memory order of a TetraMesh along a 4D space filling curve. input meshes come in whatever
+// order the tool wrote them, so neighbouring tetrahedra (one BVH leaf, one AO hemisphere)
+// end up far apart in memory. sorting the tetrahedra by the curve key of their centroids
+// and the vertices by the key of their positions puts them next to each other.
+// run it once after loading a mesh and before building its BVH or computing AO, the
+// binary cache (TetraFile.h) then stores the sorted mesh.
+
+#include "TetraMesh.h"
+#include "BVHBuild.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+enum TetraOrder {
+    TETRA_ORDER_MORTON,     // Z-order, cheap but jumps at every power of two boundary
+    TETRA_ORDER_HILBERT     // Hilbert curve, consecutive cells always touch
+};
+
+// bits 0..15 of x moved to bits 0, 4, 8, .. 60
+inline uint64_t spread_bits4(uint32_t x) {
+    uint64_t v = x & 0xFFFFu;
+    v = (v | (v << 24)) & 0x000000FF000000FFull;
+    v = (v | (v << 12)) & 0x000F000F000F000Full;
+    v = (v | (v << 6)) & 0x0303030303030303ull;
+    v = (v | (v << 3)) & 0x1111111111111111ull;
+    return v;
+}
+
+// 16 bits per axis interleaved, axis 0 in the highest bit of each group
+inline uint64_t morton_key4(const uint32_t q[4]) {
+    return (spread_bits4(q[0]) << 3) | (spread_bits4(q[1]) << 2) | (spread_bits4(q[2]) << 1) | spread_bits4(q[3]);
+}
+
+// Skilling's transpose of the Hilbert index ("Programming the Hilbert curve", 2004) for
+// 4 axes of 16 bits, interleaved like morton_key4. the branches on coordinate bits are
+// masks, they are as good as random
+inline uint64_t hilbert_key4(const uint32_t q[4]) {
+    uint32_t x[4] = { q[0], q[1], q[2], q[3] };
+
+    // inverse undo
+    for (int bit = 15; bit > 0; bit--) {
+        uint32_t P = (1u << bit) - 1;
+        for (int i = 0; i < 4; i++) {
+            uint32_t set = 0u - ((x[i] >> bit) & 1u);
+            x[0] ^= P & set;
+            uint32_t t = (x[0] ^ x[i]) & P & ~set;
+            x[0] ^= t;
+            x[i] ^= t;
+        }
+    }
+
+    // gray encode
+    for (int i = 1; i < 4; i++) x[i] ^= x[i - 1];
+    uint32_t t = 0;
+    for (int bit = 15; bit > 0; bit--)
+        t ^= ((1u << bit) - 1) & (0u - ((x[3] >> bit) & 1u));
+    for (int i = 0; i < 4; i++) x[i] ^= t;
+
+    return morton_key4(x);
+}
+
+// curve keys of points quantized to 16 bits per axis within lo/hi, threads = 0 uses every core
+inline std::vector<uint64_t> curve_keys4(const std::vector<cl_float4>& points, const float lo[4], const float hi[4], TetraOrder order, int threads = 0) {
+    std::vector<uint64_t> keys(points.size());
+    auto work = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint32_t q[4];
+            for (int a = 0; a < 4; a++) {
+                float extent = hi[a] - lo[a];
+                float f = extent > 0 ? (points[i].s[a] - lo[a]) / extent : 0.0f;
+                q[a] = (uint32_t)(std::min(std::max(f, 0.0f), 1.0f) * 65535.0f);
+            }
+            keys[i] = order == TETRA_ORDER_HILBERT ? hilbert_key4(q) : morton_key4(q);
+        }
+    };
+
+    // a thread per 64k points at most, fewer are not worth starting
+    if (threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency());
+    size_t parts = std::max<size_t>(1, std::min<size_t>(threads, points.size() >> 16));
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < parts; t++) {
+        workers.push_back(std::thread(work, points.size() * t / parts, points.size() * (t + 1) / parts));
+    }
+    work(0, points.size() / parts);
+    for (std::thread& worker : workers) worker.join();
+    return keys;
+}
+
+// sorts the tetrahedra by the key of their centroids and the vertices (with their AO values)
+// by the key of their positions, then remaps vertIndex. the mesh stays the same geometry,
+// only tetrahedron and vertex numbers change. threads = 0 uses every core for the keys
+void reorder_tetra_mesh(TetraMesh& mesh, TetraOrder order = TETRA_ORDER_HILBERT, int threads = 0) {
+    if (mesh.vertices.empty()) return;
+
+    // one box for both, so vertices and tetrahedra follow the same curve
+    float lo[4], hi[4];
+    for (int a = 0; a < 4; a++) lo[a] = hi[a] = mesh.vertices[0].s[a];
+    for (const cl_float4& v : mesh.vertices) {
+        for (int a = 0; a < 4; a++) {
+            lo[a] = std::min(lo[a], v.s[a]);
+            hi[a] = std::max(hi[a], v.s[a]);
+        }
+    }
+
+    std::vector<uint32_t> vertex_order = radix_sort_order(curve_keys4(mesh.vertices, lo, hi, order, threads));
+    std::vector<int> new_index(mesh.vertices.size());
+    std::vector<cl_float4> vertices(mesh.vertices.size());
+    for (size_t i = 0; i < vertex_order.size(); i++) {
+        vertices[i] = mesh.vertices[vertex_order[i]];
+        new_index[vertex_order[i]] = (int)i;
+    }
+    mesh.vertices.swap(vertices);
+    if (mesh.ao_values.size() == vertex_order.size()) {
+        std::vector<float> ao(vertex_order.size());
+        for (size_t i = 0; i < vertex_order.size(); i++) ao[i] = mesh.ao_values[vertex_order[i]];
+        mesh.ao_values.swap(ao);
+    }
+
+    std::vector<cl_float4> centroids(mesh.vols);
+    for (int t = 0; t < mesh.vols; t++) {
+        cl_float4 c = float4(0.0f, 0.0f, 0.0f, 0.0f);
+        for (int k = 0; k < 4; k++) {
+            int& index = mesh.vertIndex[t * 4 + k];
+            index = new_index[index];
+            for (int a = 0; a < 4; a++) c.s[a] += 0.25f * mesh.vertices[index].s[a];
+        }
+        centroids[t] = c;
+    }
+
+    std::vector<uint32_t> tetra_order = radix_sort_order(curve_keys4(centroids, lo, hi, order, threads));
+    std::vector<int> vert_index(mesh.vertIndex.size());
+    for (size_t t = 0; t < tetra_order.size(); t++) {
+        for (int k = 0; k < 4; k++) vert_index[t * 4 + k] = mesh.vertIndex[tetra_order[t] * 4 + k];
+    }
+    mesh.vertIndex.swap(vert_index);
+}
+
+#endif
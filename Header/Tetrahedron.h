@@ -4,11 +4,12 @@
 #include "Ray4.h"
 #include "Hittable4.h"
 #include "vec4.h"
+#include "Det4.h"
 
 class Tetrahedron : public Hittable4 {
 public:
     Tetrahedron() {}
-    Tetrahedron(Point4 a, Point4 b, Point4 c, Point4 d, shared_ptr<Material> m) : A(a), B(b), C(c), D(d), mat_ptr(m) {};
+    Tetrahedron(Point4 a, Point4 b, Point4 c, Point4 d, uint32_t m) : A(a), B(b), C(c), D(d), material_id(m) {};
 
     virtual bool hit(const Ray4& r, double tmin, double tmax, hit_record4& rec) const;
 
@@ -17,29 +18,12 @@ private:
     Point4 B;
     Point4 C;
     Point4 D;
-    shared_ptr<Material> mat_ptr;
+    uint32_t material_id;
     vec4 normal;
 };
 
 double determinant4(vec4 v0, vec4 v1, vec4 v2, vec4 v3) {
-      double det =  v0.w()* v1.z()* v2.y()* v3.x() - v0.z() * v1.w() * v2.y() * v3.x() -
-                    v0.w() * v1.y() * v2.z() * v3.x() + v0.y() * v1.w() * v2.z() * v3.x() +
-
-                    v0.z() * v1.y() * v2.w() * v3.x() - v0.y() * v1.z() * v2.w() * v3.x() -
-                    v0.w() * v1.z() * v2.x() * v3.y() + v0.z() * v1.w() * v2.x() * v3.y() +
-
-                    v0.w() * v1.x() * v2.z() * v3.y() - v0.x() * v1.w() * v2.z() * v3.y() -
-                    v0.z() * v1.x() * v2.w() * v3.y() + v0.x() * v1.z() * v2.w() * v3.y() +
-
-                    v0.w() * v1.y() * v2.x() * v3.z() - v0.y() * v1.w() * v2.x() * v3.z() -
-                    v0.w() * v1.x() * v2.y() * v3.z() + v0.x() * v1.w() * v2.y() * v3.z() +
-
-                    v0.y() * v1.x() * v2.w() * v3.z() - v0.x() * v1.y() * v2.w() * v3.z() -
-                    v0.z() * v1.y() * v2.x() * v3.w() + v0.y() * v1.z() * v2.x() * v3.w() +
-
-                    v0.z() * v1.x() * v2.y() * v3.w() - v0.x() * v1.z() * v2.y() * v3.w() -
-                    v0.y() * v1.x() * v2.z() * v3.w() + v0.x() * v1.y() * v2.z() * v3.w();
-      return det;
+    return det4(v0.e, v1.e, v2.e, v3.e);
 }
 
 bool Tetrahedron::hit(const Ray4& r, double tmin, double tmax, hit_record4& rec) const {
@@ -47,11 +31,21 @@ bool Tetrahedron::hit(const Ray4& r, double tmin, double tmax, hit_record4& rec)
     double t = dot(normal, r.direction());
     vec4 P = r.at(t);
 
-    double det0 = determinant4(A, B, C, D);
-    double det1 = determinant4(P, B, C, D);
-    double det2 = determinant4(A, P, C, D);
-    double det3 = determinant4(A, B, P, D);
-    double det4 = determinant4(A, B, C, P);
+    // the five determinants share rows, so they are built from the minors of (A, B) and (C, D):
+    // det(x, B, C, D) = dot(x, nB), det(A, x, C, D) = -dot(x, nA), det(A, B, x, y) = dot(g(x), y)
+    double ab[6], cd[6], nA[4], nB[4], gC[4], gP[4];
+    minors4(A.e, B.e, ab);
+    minors4(C.e, D.e, cd);
+    det4_first_row(A.e, cd, nA);
+    det4_first_row(B.e, cd, nB);
+    det4_last_row(ab, C.e, gC);
+    det4_last_row(ab, P.e, gP);
+
+    double det0 = det4_minors(ab, cd);
+    double det1 = dot4(P.e, nB);
+    double det2 = -dot4(P.e, nA);
+    double det3 = dot4(gP, D.e);
+    double det4 = dot4(gC, P.e);
 
 
     double bary_coord0 = det1 / det0;
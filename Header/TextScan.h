@@ -0,0 +1,130 @@
+#ifndef TEXTSCAN_H
+#define TEXTSCAN_H
+
+// number scanning for the mesh loaders. every function works on [p, end) of a mapped file
+// and leaves p after what it read: no locale, no allocation, no terminating zero needed.
+// large files are cut into line aligned chunks that threads scan side by side.
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+inline void scan_skip_blanks(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+}
+
+inline void scan_skip_line(const char*& p, const char* end) {
+    while (p < end && *p != '\n') p++;
+    if (p < end) p++;
+}
+
+// skips blank and comment lines, false at the end. p is left on the first field of the record
+inline bool scan_next_record(const char*& p, const char* end) {
+    while (p < end) {
+        scan_skip_blanks(p, end);
+        if (p < end && *p != '\n' && *p != '#') return true;
+        scan_skip_line(p, end);
+    }
+    return false;
+}
+
+inline bool scan_int(const char*& p, const char* end, long long& value) {
+    scan_skip_blanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    const char* digits = p;
+    long long v = 0;
+    while (p < end && *p >= '0' && *p <= '9' && p - digits < 18) v = v * 10 + (*p++ - '0');
+    if (p == digits || (p < end && *p >= '0' && *p <= '9')) return false;
+    value = negative ? -v : v;
+    return true;
+}
+
+// decimal mantissa of up to 19 digits scaled by a power of ten in double, then rounded to
+// T once: exact for everything a mesh tool prints with float precision
+template <typename T>
+inline bool scan_real(const char*& p, const char* end, T& value) {
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+                                     1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    scan_skip_blanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+        if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) digits++; }
+        else exponent++;
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+            if (digits < 19) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa) digits++; exponent--; }
+        }
+    }
+    if (!any) return false;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        long long e;
+        if (!scan_int(p, end, e)) return false;
+        exponent += (int)std::max(-1000LL, std::min(1000LL, e));
+    }
+
+    double v = (double)mantissa;
+    if (exponent < 0) {
+        while (exponent < -22) { v /= 1e22; exponent += 22; }
+        v /= powers[-exponent];
+    }
+    else {
+        while (exponent > 22) { v *= 1e22; exponent -= 22; }
+        v *= powers[exponent];
+    }
+    value = (T)(negative ? -v : v);
+    return true;
+}
+
+inline bool scan_float(const char*& p, const char* end, float& value) { return scan_real(p, end, value); }
+inline bool scan_float(const char*& p, const char* end, double& value) { return scan_real(p, end, value); }
+
+// how many chunks `bytes` are worth, threads = 0 uses every core.
+// a thread for less than a megabyte costs more than it saves
+inline int scan_chunk_count(size_t bytes, int threads) {
+    if (threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency());
+    return (int)std::max<size_t>(1, std::min<size_t>(threads, bytes >> 20));
+}
+
+// [begin, end) cut into `parts` ranges that start at the beginning of a line,
+// chunk i is [cuts[i], cuts[i + 1])
+inline std::vector<const char*> scan_line_chunks(const char* begin, const char* end, int parts) {
+    std::vector<const char*> cuts(1, begin);
+    for (int i = 1; i < parts; i++) {
+        const char* p = std::max(cuts.back(), begin + (end - begin) * i / parts);
+        while (p < end && p[-1] != '\n') p++;
+        cuts.push_back(p);
+    }
+    cuts.push_back(end);
+    return cuts;
+}
+
+// runs work(i, error) for i in [0, parts), the first one on the calling thread.
+// returns the error of the lowest failing part, empty when all succeed
+template <typename Work>
+std::string scan_parallel(int parts, Work work) {
+    std::vector<std::string> errors(parts);
+    std::vector<std::thread> workers;
+    for (int i = 1; i < parts; i++) {
+        workers.push_back(std::thread([&, i]() { work(i, errors[i]); }));
+    }
+    if (parts > 0) work(0, errors[0]);
+    for (std::thread& worker : workers) worker.join();
+
+    for (const std::string& error : errors) {
+        if (!error.empty()) return error;
+    }
+    return std::string();
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef TRACESTATS_H
+#define TRACESTATS_H
+
+// traversal counters for finding out why a render is slow. define TRACE_STATS to compile
+// them in, without it TRACE_STAT(...) expands to nothing and the traversals are unchanged.
+// every thread counts into its own TraceStats, so the hot loops need no atomics; a thread
+// adds its counters to the process total with trace_stats_flush when it is done.
+
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+
+#ifdef TRACE_STATS
+#define TRACE_STAT(statement) statement
+#else
+#define TRACE_STAT(statement)
+#endif
+
+struct TraceStats {
+    uint64_t rays = 0;              // traversals started
+    uint64_t hits = 0;              // traversals that found something
+    uint64_t box_tests = 0;
+    uint64_t nodes_visited = 0;     // nodes whose box the ray entered
+    uint64_t primitive_tests = 0;   // tetrahedra or triangles
+    uint64_t ao_rays = 0;
+    uint64_t ao_vertices = 0;       // vertices the AO rays start on
+
+    void add(const TraceStats& other) {
+        rays += other.rays;
+        hits += other.hits;
+        box_tests += other.box_tests;
+        nodes_visited += other.nodes_visited;
+        primitive_tests += other.primitive_tests;
+        ao_rays += other.ao_rays;
+        ao_vertices += other.ao_vertices;
+    }
+
+    // what the traversals so far cost, the heat map counts this per voxel
+    uint64_t tests() const { return box_tests + primitive_tests; }
+};
+
+// counters of the calling thread
+inline TraceStats& thread_trace_stats() {
+    static thread_local TraceStats stats;
+    return stats;
+}
+
+inline std::mutex& trace_stats_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+inline TraceStats& total_trace_stats() {
+    static TraceStats total;
+    return total;
+}
+
+// moves the calling thread's counters into the total
+inline void trace_stats_flush() {
+    TraceStats& stats = thread_trace_stats();
+    std::lock_guard<std::mutex> lock(trace_stats_mutex());
+    total_trace_stats().add(stats);
+    stats = TraceStats();
+}
+
+// flushes the calling thread and prints the total, the other threads have to be flushed already
+inline void print_trace_stats(std::ostream& out = std::cout) {
+    trace_stats_flush();
+    std::lock_guard<std::mutex> lock(trace_stats_mutex());
+    const TraceStats& total = total_trace_stats();
+    double rays = total.rays > 0 ? (double)total.rays : 1.0;
+    out << "Traversal: " << total.rays << " rays, " << total.hits << " hits (" << 100.0 * total.hits / rays << "%)\n"
+        << "  per ray: " << total.nodes_visited / rays << " nodes visited, " << total.box_tests / rays << " box tests, "
+        << total.primitive_tests / rays << " primitive tests\n";
+    if (total.ao_vertices > 0) {
+        out << "  AO: " << total.ao_rays << " rays, " << (double)total.ao_rays / total.ao_vertices << " per vertex\n";
+    }
+}
+
+#endif
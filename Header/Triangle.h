@@ -2,12 +2,13 @@
 #define TRIANGLE_H
 
 #include "Hittable.h"
+#include "HitQuery.h"
 #include "vec3.h"
 
 class Triangle : public Hittable {
     public: 
         Triangle() {}
-        Triangle(Point3 a, Point3 b, Point3 c, shared_ptr<Material> m): A(a), B(b), C(c), mat_ptr(m){
+        Triangle(Point3 a, Point3 b, Point3 c, uint32_t m): A(a), B(b), C(c), material_id(m){
             vec3 temp = cross((B - A), (C - A));
             normal = temp/temp.length();
         };
@@ -20,38 +21,59 @@ class Triangle : public Hittable {
         Point3 A;
         Point3 B;
         Point3 C;
-        shared_ptr<Material> mat_ptr;
+        uint32_t material_id;
         vec3 normal;
 };
 
-bool Triangle::hit(const Ray& r, double tmin, double tmax, hit_record& rec) const{
-    //calculate using barycentric coordinates and Cramer's rule for solving linear system
-
-    double temp = dot(normal, A);
-    double t = -(dot(normal, r.origin()) + temp) / (dot(normal, r.direction()));
-
-    vec3 P = r.at(t);
-    vec3 v0 = C-A;
-    vec3 v1 = B-A;
-    vec3 v2 = P-A;
-
-    double d00 = dot(v0, v0);
-    double d01 = dot(v0, v1);
-    double d02 = dot(v0, v2);
-    double d11 = dot(v1, v1);
-    double d12 = dot(v1, v2);
-
-    double denom = 1/((d00*d11)-(d01*d01));
-    double u = ((d11*d02) - (d01*d12))*denom;
-    double v = ((d00*d12) - (d01*d02))*denom;
-
-    return (u>= 0) && (v>= 0) && (u+v<1);
-
+// Moller-Trumbore ray/triangle test with the edges e1 = v1 - v0 and e2 = v2 - v0, for one
+// Query (see HitQuery.h). u and v are the barycentric coordinates of v1 and v2, written when
+// the query asks for them. the default hits from both sides within [t_min, t_max]
+template <typename Query = ClosestHitQuery>
+inline bool intersect_triangle(const Point3& v0, const vec3& e1, const vec3& e2, const Ray& r,
+                               double t_min, double t_max, double& t, double& u, double& v) {
+    vec3 pvec = cross(r.direction(), e2);
+    double det = dot(e1, pvec);
+    if (Query::cull_backfaces) {
+        if (det < 1e-12) return false;
+    }
+    else if (std::fabs(det) < 1e-12) return false;
+    double inv_det = 1.0 / det;
+
+    vec3 tvec = r.origin() - v0;
+    double b1 = dot(tvec, pvec) * inv_det;
+    if (b1 < 0 || b1 > 1) return false;
+
+    vec3 qvec = cross(tvec, e1);
+    double b2 = dot(r.direction(), qvec) * inv_det;
+    if (b2 < 0 || b1 + b2 > 1) return false;
+
+    t = dot(e2, qvec) * inv_det;
+    if (Query::clip_interval && (t < t_min || t > t_max)) return false;
+
+    if (Query::barycentrics) {
+        u = b1;
+        v = b2;
+    }
+    return true;
+}
 
+bool Triangle::hit(const Ray& r, double tmin, double tmax, hit_record& rec) const{
+    double t, u, v;
+    if (!intersect_triangle(A, B - A, C - A, r, tmin, tmax, t, u, v))
+        return false;
+
+    rec.t = t;
+    rec.u = u;
+    rec.v = v;
+    rec.p = r.at(t);
+    rec.set_face_normal(r, normal);
+    rec.material_id = material_id;
+    return true;
 }
 
 bool Triangle::bounding_box(double t0, double t1, BoundingBox& output_box) const {
-    output_box = BoundingBox(A, vec3(B.x(),C.y(), B.z()));
+    output_box = BoundingBox(Point3(fmin(A.x(), fmin(B.x(), C.x())), fmin(A.y(), fmin(B.y(), C.y())), fmin(A.z(), fmin(B.z(), C.z()))),
+                             Point3(fmax(A.x(), fmax(B.x(), C.x())), fmax(A.y(), fmax(B.y(), C.y())), fmax(A.z(), fmax(B.z(), C.z()))));
     return true;
 }
 
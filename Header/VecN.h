@@ -0,0 +1,161 @@
+#ifndef VECN_H
+#define VECN_H
+
+#include <cmath>
+#include <iostream>
+
+#include "vecsimd.h"
+
+using std::sqrt;
+
+// D dimensional vector over the scalar type T. vec3_t and vec4_t are VecN<3, T> and
+// VecN<4, T>, so everything written against VecN (rays, boxes, BVHs) serves both.
+// the storage is padded to the SIMD width of vecsimd.h, padding elements are always 0
+template <int D, typename T>
+class VecN {
+    public:
+        typedef T scalar;
+        static const int dimension = D;
+        static const int lanes = (D == 3) ? VEC3_LANES : D;
+
+        VecN() : e{} {}
+        VecN(T e0, T e1, T e2) : e{e0, e1, e2} {
+            static_assert(D == 3, "three components for a 3D vector");
+        }
+        VecN(T e0, T e1, T e2, T e3) : e{e0, e1, e2, e3} {
+            static_assert(D == 4, "four components for a 4D vector");
+        }
+
+        // conversion between precisions has to be asked for
+        template <typename U>
+        explicit VecN(const VecN<D, U>& v) : e{} {
+            for (int i = 0; i < D; i++) e[i] = (T)v.e[i];
+        }
+
+        T x() const { return e[0]; }
+        T y() const { return e[1]; }
+        T z() const { return e[2]; }
+        T w() const { static_assert(D >= 4, "no w in a 3D vector"); return e[3]; }
+
+        VecN operator-() const {
+            VecN r;
+            lanes_scale<T, lanes>(r.e, e, -1);
+            return r;
+        }
+        T operator[](int i) const { return e[i]; }
+        T& operator[](int i) { return e[i]; }
+
+        VecN& operator+=(const VecN &v) {
+            lanes_add<T, lanes>(e, e, v.e);
+            return *this;
+        }
+
+        VecN& operator*=(const T t) {
+            lanes_scale<T, lanes>(e, e, t);
+            return *this;
+        }
+
+        VecN& operator/=(const T t) {
+            return *this *= 1/t;
+        }
+
+        T length() const {
+            return sqrt(length_squared());
+        }
+
+        T length_squared() const {
+            return lanes_dot<T, lanes>(e, e);
+        }
+
+        inline static VecN random() {
+            VecN r;
+            for (int i = 0; i < D; i++) r.e[i] = (T)random_double();
+            return r;
+        }
+
+        inline static VecN random(double min, double max) {
+            VecN r;
+            for (int i = 0; i < D; i++) r.e[i] = (T)random_double(min, max);
+            return r;
+        }
+
+    public:
+        T e[lanes];
+};
+
+
+// VecN Utility Functions
+// scalars are taken as VecN::scalar so T comes from the vector alone and
+// 0.5 * v works for float vectors too
+
+template <int D, typename T>
+inline std::ostream& operator<<(std::ostream &out, const VecN<D, T> &v) {
+    out << v.e[0];
+    for (int i = 1; i < D; i++) out << ' ' << v.e[i];
+    return out;
+}
+
+template <int D, typename T>
+inline VecN<D, T> operator+(const VecN<D, T> &u, const VecN<D, T> &v) {
+    VecN<D, T> r;
+    lanes_add<T, VecN<D, T>::lanes>(r.e, u.e, v.e);
+    return r;
+}
+
+template <int D, typename T>
+inline VecN<D, T> operator-(const VecN<D, T> &u, const VecN<D, T> &v) {
+    VecN<D, T> r;
+    lanes_sub<T, VecN<D, T>::lanes>(r.e, u.e, v.e);
+    return r;
+}
+
+template <int D, typename T>
+inline VecN<D, T> operator*(const VecN<D, T> &u, const VecN<D, T> &v) {
+    VecN<D, T> r;
+    lanes_mul<T, VecN<D, T>::lanes>(r.e, u.e, v.e);
+    return r;
+}
+
+template <int D, typename T>
+inline VecN<D, T> operator*(typename VecN<D, T>::scalar t, const VecN<D, T> &v) {
+    VecN<D, T> r;
+    lanes_scale<T, VecN<D, T>::lanes>(r.e, v.e, t);
+    return r;
+}
+
+template <int D, typename T>
+inline VecN<D, T> operator*(const VecN<D, T> &v, typename VecN<D, T>::scalar t) {
+    return t * v;
+}
+
+template <int D, typename T>
+inline VecN<D, T> operator/(VecN<D, T> v, typename VecN<D, T>::scalar t) {
+    return (1/t) * v;
+}
+
+template <int D, typename T>
+inline T dot(const VecN<D, T> &u, const VecN<D, T> &v) {
+    return lanes_dot<T, VecN<D, T>::lanes>(u.e, v.e);
+}
+
+template <int D, typename T>
+inline VecN<D, T> unit_vector(VecN<D, T> v) {
+    return v / v.length();
+}
+
+// component wise minimum and maximum, for boxes
+template <int D, typename T>
+inline VecN<D, T> vmin(const VecN<D, T> &u, const VecN<D, T> &v) {
+    VecN<D, T> r;
+    for (int i = 0; i < D; i++) r.e[i] = u.e[i] < v.e[i] ? u.e[i] : v.e[i];
+    return r;
+}
+
+template <int D, typename T>
+inline VecN<D, T> vmax(const VecN<D, T> &u, const VecN<D, T> &v) {
+    VecN<D, T> r;
+    for (int i = 0; i < D; i++) r.e[i] = u.e[i] > v.e[i] ? u.e[i] : v.e[i];
+    return r;
+}
+
+#endif
@@ -1,112 +1,30 @@
 #ifndef VEC3_H
 #define VEC3_H
 
-#include <cmath>
-#include <iostream>
-
-using std::sqrt;
-
-class vec3 {
-    public:
-        vec3() : e{0,0,0} {}
-        vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
-
-        double x() const { return e[0]; }
-        double y() const { return e[1]; }
-        double z() const { return e[2]; }
-
-        vec3 operator-() const { return vec3(-e[0], -e[1], -e[2]); }
-        double operator[](int i) const { return e[i]; }
-        double& operator[](int i) { return e[i]; }
-
-        vec3& operator+=(const vec3 &v) {
-            e[0] += v.e[0];
-            e[1] += v.e[1];
-            e[2] += v.e[2];
-            return *this;
-        }
-
-        vec3& operator*=(const double t) {
-            e[0] *= t;
-            e[1] *= t;
-            e[2] *= t;
-            return *this;
-        }
-
-        vec3& operator/=(const double t) {
-            return *this *= 1/t;
-        }
-
-        double length() const {
-            return sqrt(length_squared());
-        }
-
-        double length_squared() const {
-            return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
-        }
-
-        inline static vec3 random(){
-            return vec3(random_double(), random_double(), random_double());
-        }
-
-        inline static vec3 random(double min, double max){
-            return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
-        }
-    
-    public:
-        double e[3];
-};
+#include "VecN.h"
 
+// 3D vector over the scalar type T. vec3 (double) is what the renderer uses,
+// vec3f halves the memory traffic where float precision is enough.
+// the class and its operators are VecN, with AVX the storage is padded to four lanes
+template <typename T>
+using vec3_t = VecN<3, T>;
 
 // Type aliases for vec3
+using vec3 = vec3_t<double>;
 using Point3 = vec3;   // 3D point
 using Color = vec3;    // RGB color
 
+using vec3f = vec3_t<float>;
+using Point3f = vec3f;
 
-// vec3 Utility Functions
-
-inline std::ostream& operator<<(std::ostream &out, const vec3 &v) {
-    return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
-}
-
-inline vec3 operator+(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
-}
-
-inline vec3 operator-(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
-}
-
-inline vec3 operator*(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
-}
-
-inline vec3 operator*(double t, const vec3 &v) {
-    return vec3(t*v.e[0], t*v.e[1], t*v.e[2]);
-}
 
-inline vec3 operator*(const vec3 &v, double t) {
-    return t * v;
-}
-
-inline vec3 operator/(vec3 v, double t) {
-    return (1/t) * v;
-}
-
-inline double dot(const vec3 &u, const vec3 &v) {
-    return u.e[0] * v.e[0]
-         + u.e[1] * v.e[1]
-         + u.e[2] * v.e[2];
-}
-
-inline vec3 cross(const vec3 &u, const vec3 &v) {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-                u.e[2] * v.e[0] - u.e[0] * v.e[2],
-                u.e[0] * v.e[1] - u.e[1] * v.e[0]);
-}
+// vec3 Utility Functions
 
-inline vec3 unit_vector(vec3 v) {
-    return v / v.length();
+template <typename T>
+inline vec3_t<T> cross(const vec3_t<T> &u, const vec3_t<T> &v) {
+    vec3_t<T> r;
+    lanes_cross3<T, VEC3_LANES>(r.e, u.e, v.e);
+    return r;
 }
 
 vec3 random_in_unit_sphere() {
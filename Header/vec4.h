@@ -2,128 +2,30 @@
 #ifndef vec4_H
 #define vec4_H
 
-#include <cmath>
-#include <iostream>
 #include "Renderer.h"
+#include "VecN.h"
 
-using std::sqrt;
-
-class vec4 {
-public:
-    vec4() : e{ 0,0,0 } {}
-    vec4(double e0, double e1, double e2, double e3) : e{ e0, e1, e2, e3} {}
-
-    double x() const { return e[0]; }
-    double y() const { return e[1]; }
-    double z() const { return e[2]; }
-    double w() const { return e[3]; }
-
-    vec4 operator-() const { return vec4(-e[0], -e[1], -e[2], -e[3]); }
-    double operator[](int i) const { return e[i]; }
-    double& operator[](int i) { return e[i]; }
-
-    vec4& operator+=(const vec4& v) {
-        e[0] += v.e[0];
-        e[1] += v.e[1];
-        e[2] += v.e[2];
-        e[3] += v.e[3];
-        return *this;
-    }
-
-    vec4& operator*=(const double t) {
-        e[0] *= t;
-        e[1] *= t;
-        e[2] *= t;
-        e[3] *= t;
-        return *this;
-    }
-
-    vec4& operator/=(const double t) {
-        return *this *= 1 / t;
-    }
-
-    double length() const {
-        return sqrt(length_squared());
-    }
-
-    double length_squared() const {
-        return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
-    }
-
-    inline static vec4 random() {
-        return vec4(random_double(), random_double(), random_double(), random_double());
-    }
-
-    inline static vec4 random(double min, double max) {
-        return vec4(random_double(min, max), random_double(min, max), random_double(min, max), random_double(min, max));
-    }
-
-public:
-    double e[4];
-};
-
+// 4D vector over the scalar type T, like vec3_t. vec4 is double, vec4f float.
+// a vec4 is exactly one __m256d, with AVX the operators of VecN work on the whole register
+template <typename T>
+using vec4_t = VecN<4, T>;
 
 // Type aliases for vec4
+using vec4 = vec4_t<double>;
 using Point4 = vec4;   // 4D point
 
+using vec4f = vec4_t<float>;
+using Point4f = vec4f;
 
-// vec4 Utility Functions
-
-inline std::ostream& operator<<(std::ostream& out, const vec4& v) {
-    return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
-}
-
-inline vec4 operator+(const vec4& u, const vec4& v) {
-    return vec4(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2], u.e[3] + v.e[3]);
-}
-
-inline vec4 operator-(const vec4& u, const vec4& v) {
-    return vec4(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2], u.e[3] - v.e[3]);
-}
-
-inline vec4 operator*(const vec4& u, const vec4& v) {
-    return vec4(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2], u.e[3] * v.e[3]);
-}
-
-inline vec4 operator*(double t, const vec4& v) {
-    return vec4(t * v.e[0], t * v.e[1], t * v.e[2], t * v.e[3]);
-}
-
-inline vec4 operator*(const vec4& v, double t) {
-    return t * v;
-}
-
-inline vec4 operator/(vec4 v, double t) {
-    return (1 / t) * v;
-}
-
-inline double dot(const vec4& u, const vec4& v) {
-    return u.e[0] * v.e[0]
-        + u.e[1] * v.e[1]
-        + u.e[2] * v.e[2]
-        + u.e[3] * v.e[3];
-}
 
+// vec4 Utility Functions
 
 //FROM https://github.com/hollasch/ray4
-inline vec4 cross(const vec4& u, const vec4& v, const vec4& w) {
-    double A = (v[0] * w[1]) - (v[1] * w[0]);
-    double B = (v[0] * w[2]) - (v[2] * w[0]);
-    double C = (v[0] * w[3]) - (v[3] * w[0]);
-    double D = (v[1] * w[2]) - (v[2] * w[1]);
-    double E = (v[1] * w[3]) - (v[3] * w[1]);
-    double F = (v[2] * w[3]) - (v[3] * w[2]);
-
-    return vec4(
-        (u[1] * F) - (u[2] * E) + (u[3] * D),
-        -(u[0] * F) + (u[2] * C) - (u[3] * B),
-        (u[0] * E) - (u[1] * C) + (u[3] * A),
-        -(u[0] * D) + (u[1] * B) - (u[2] * A)
-    );
-}
-
-inline vec4 unit_vector(vec4 v) {
-    return v / v.length();
+template <typename T>
+inline vec4_t<T> cross(const vec4_t<T>& u, const vec4_t<T>& v, const vec4_t<T>& w) {
+    vec4_t<T> r;
+    lanes_cross4<T, 4>(r.e, u.e, v.e, w.e);
+    return r;
 }
 
 vec4 random_v4_in_unit_sphere() {
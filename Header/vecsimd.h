@@ -0,0 +1,139 @@
+#ifndef VECSIMD_H
+#define VECSIMD_H
+
+// lane helpers behind vec3_t and vec4_t. the plain loops are the portable version, with AVX
+// the double versions are replaced by __m256d code (one vec4, or one padded vec3, per
+// register). define VEC_NO_SIMD to force the loops.
+// the types are not over-aligned and the loads are unaligned: before C++17 new and
+// std::vector only promise 16 bytes, and the compiler's own aligned moves would fault
+
+#if defined(__AVX__) && !defined(VEC_NO_SIMD)
+#define VEC_AVX
+#include <immintrin.h>
+#endif
+
+// vec3 gets a fourth, always zero, element when the lanes are 4 wide
+#ifdef VEC_AVX
+#define VEC3_LANES 4
+#else
+#define VEC3_LANES 3
+#endif
+
+template <typename T, int N>
+inline void lanes_add(T* r, const T* a, const T* b) {
+    for (int i = 0; i < N; i++) r[i] = a[i] + b[i];
+}
+
+template <typename T, int N>
+inline void lanes_sub(T* r, const T* a, const T* b) {
+    for (int i = 0; i < N; i++) r[i] = a[i] - b[i];
+}
+
+template <typename T, int N>
+inline void lanes_mul(T* r, const T* a, const T* b) {
+    for (int i = 0; i < N; i++) r[i] = a[i] * b[i];
+}
+
+template <typename T, int N>
+inline void lanes_scale(T* r, const T* a, T t) {
+    for (int i = 0; i < N; i++) r[i] = a[i] * t;
+}
+
+template <typename T, int N>
+inline T lanes_dot(const T* a, const T* b) {
+    T res = 0;
+    for (int i = 0; i < N; i++) res += a[i] * b[i];
+    return res;
+}
+
+// a.yzx * b.zxy - a.zxy * b.yzx, the padding lane stays zero
+template <typename T, int N>
+inline void lanes_cross3(T* r, const T* a, const T* b) {
+    T x = a[1] * b[2] - a[2] * b[1];
+    T y = a[2] * b[0] - a[0] * b[2];
+    T z = a[0] * b[1] - a[1] * b[0];
+    r[0] = x;
+    r[1] = y;
+    r[2] = z;
+}
+
+// 4D cross product of u, v and w, see cross() in vec4.h. A to F are the 2x2 minors of v and w
+template <typename T, int N>
+inline void lanes_cross4(T* r, const T* u, const T* v, const T* w) {
+    T A = (v[0] * w[1]) - (v[1] * w[0]);
+    T B = (v[0] * w[2]) - (v[2] * w[0]);
+    T C = (v[0] * w[3]) - (v[3] * w[0]);
+    T D = (v[1] * w[2]) - (v[2] * w[1]);
+    T E = (v[1] * w[3]) - (v[3] * w[1]);
+    T F = (v[2] * w[3]) - (v[3] * w[2]);
+
+    r[0] = (u[1] * F) - (u[2] * E) + (u[3] * D);
+    r[1] = -(u[0] * F) + (u[2] * C) - (u[3] * B);
+    r[2] = (u[0] * E) - (u[1] * C) + (u[3] * A);
+    r[3] = -(u[0] * D) + (u[1] * B) - (u[2] * A);
+}
+
+#ifdef VEC_AVX
+
+// sum of the four lanes
+inline double hsum(__m256d v) {
+    __m128d lo = _mm256_castpd256_pd128(v);
+    __m128d hi = _mm256_extractf128_pd(v, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+template <>
+inline void lanes_add<double, 4>(double* r, const double* a, const double* b) {
+    _mm256_storeu_pd(r, _mm256_add_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+}
+
+template <>
+inline void lanes_sub<double, 4>(double* r, const double* a, const double* b) {
+    _mm256_storeu_pd(r, _mm256_sub_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+}
+
+template <>
+inline void lanes_mul<double, 4>(double* r, const double* a, const double* b) {
+    _mm256_storeu_pd(r, _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+}
+
+template <>
+inline void lanes_scale<double, 4>(double* r, const double* a, double t) {
+    _mm256_storeu_pd(r, _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_set1_pd(t)));
+}
+
+template <>
+inline double lanes_dot<double, 4>(const double* a, const double* b) {
+    return hsum(_mm256_mul_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+}
+
+template <>
+inline void lanes_cross3<double, 4>(double* r, const double* a, const double* b) {
+    __m256d a_yzx = _mm256_set_pd(0, a[0], a[2], a[1]);
+    __m256d a_zxy = _mm256_set_pd(0, a[1], a[0], a[2]);
+    __m256d b_yzx = _mm256_set_pd(0, b[0], b[2], b[1]);
+    __m256d b_zxy = _mm256_set_pd(0, b[1], b[0], b[2]);
+    _mm256_storeu_pd(r, _mm256_sub_pd(_mm256_mul_pd(a_yzx, b_zxy), _mm256_mul_pd(a_zxy, b_yzx)));
+}
+
+// A to D in one register, E and F on the side, then every output lane is three products
+template <>
+inline void lanes_cross4<double, 4>(double* r, const double* u, const double* v, const double* w) {
+    alignas(32) double m[4];
+    _mm256_store_pd(m, _mm256_sub_pd(
+        _mm256_mul_pd(_mm256_set_pd(v[1], v[0], v[0], v[0]), _mm256_set_pd(w[2], w[3], w[2], w[1])),
+        _mm256_mul_pd(_mm256_set_pd(v[2], v[3], v[2], v[1]), _mm256_set_pd(w[1], w[0], w[0], w[0]))));
+    double A = m[0], B = m[1], C = m[2], D = m[3];
+    double E = (v[1] * w[3]) - (v[3] * w[1]);
+    double F = (v[2] * w[3]) - (v[3] * w[2]);
+
+    __m256d res = _mm256_mul_pd(_mm256_set_pd(u[0], u[0], u[0], u[1]), _mm256_set_pd(-D, E, -F, F));
+    res = _mm256_add_pd(res, _mm256_mul_pd(_mm256_set_pd(u[1], u[1], u[2], u[2]), _mm256_set_pd(B, -C, C, -E)));
+    res = _mm256_add_pd(res, _mm256_mul_pd(_mm256_set_pd(u[2], u[3], u[3], u[3]), _mm256_set_pd(-A, A, -B, D)));
+    _mm256_storeu_pd(r, res);
+}
+
+#endif
+
+#endif
@@ -46,40 +46,93 @@ struct TetraMesh{
 };
 
 
-static float get_random(unsigned int *seed0, unsigned int *seed1){
-    *seed0 = 36969 * ((*seed0) & 65535) + ((*seed0) >> 16);  
-	*seed1 = 18000 * ((*seed1) & 65535) + ((*seed1) >> 16);
+// Philox4x32-10 counter based random numbers, same generator as Header/Philox.h.
+// a number depends only on (id, sample, pass, stream) and the seed, so every work-item
+// can draw any sample on its own and host and device agree bit for bit
+uint4 philox4x32(uint4 ctr, uint2 key){
+    for (int round = 0; round < 10; round++){
+        uint hi0 = mul_hi(0xD2511F53u, ctr.x);
+        uint lo0 = 0xD2511F53u * ctr.x;
+        uint hi1 = mul_hi(0xCD9E8D57u, ctr.z);
+        uint lo1 = 0xCD9E8D57u * ctr.z;
+
+        ctr = (uint4)(hi1 ^ ctr.y ^ key.x, lo1, hi0 ^ ctr.w ^ key.y, lo0);
+        key += (uint2)(0x9E3779B9u, 0xBB67AE85u);
+    }
+    return ctr;
+}
 
-    unsigned int ires = ((*seed0) << 16) + (*seed1);
+// four uniforms in [0,1), seed is the 64 bit host seed split into (low, high) words
+float4 random_uniform4(uint id, uint sample, uint pass, uint stream, uint2 seed){
+    uint4 r = philox4x32((uint4)(id, sample, pass, stream), seed);
+    return convert_float4(r >> 8) * (1.0f / 16777216.0f);
+}
 
-    union {
-		float f;
-		unsigned int ui;
-	} res;
+// 4x4 determinants from 2x2 minors, the same scheme as Det4.h on the host.
+// minors of the rows a and b: (01, 02, 03, 12) in lo, (13, 23) in hi
+void minors4(float4 a, float4 b, float4* lo, float2* hi){
+    *lo = a.xxxy * b.yzwz - a.yzwz * b.xxxy;
+    *hi = a.yz * b.ww - a.ww * b.yz;
+}
 
-    res.ui = (ires & 0x007fffff) | 0x40000000;
-    return (res.f - 2.0f) / 2.0f;
+// det(a, b, c, d) from the minors of (a, b) and (c, d)
+float det4_minors(float4 ab, float2 ab2, float4 cd, float2 cd2){
+    return dot(ab, (float4)(cd2.y, -cd2.x, cd.w, cd.z)) + dot(ab2, (float2)(-cd.y, cd.x));
+}
+
+// n with dot(x, n) = det(x, b, c, d), cd = minors of (c, d)
+float4 det4_first_row(float4 b, float4 cd, float2 cd2){
+    return b.yzxy * (float4)(cd2.y, cd.z, cd2.x, cd.y)
+         - b.zxyx * (float4)(cd2.x, cd2.y, cd.z, cd.w)
+         + b.wwwz * (float4)(cd.w, -cd.y, cd.x, -cd.x);
+}
+
+// g with dot(g, d) = det(a, b, c, d), ab = minors of (a, b)
+float4 det4_last_row(float4 ab, float2 ab2, float4 c){
+    return (float4)(ab2.x*c.z - ab.w*c.w - ab2.y*c.y,
+                    ab.y*c.w - ab.z*c.z + ab2.y*c.x,
+                    ab.z*c.y - ab.x*c.w - ab2.x*c.x,
+                    ab.x*c.z - ab.y*c.y + ab.w*c.x);
 }
 
 float det4(float4 A, float4 B, float4 C, float4 D){
-    float res = 0.0;
-    res += A.s0 * ((B.s1*C.s2*D.s3) + (C.s1*D.s2*B.s3) + (D.s1*B.s2*C.s3) - (B.s3*C.s2*D.s1) - (C.s3*D.s2*B.s1) - (D.s3*B.s2*C.s1));
-    res -= A.s1 * ((B.s0*C.s2*D.s3) + (C.s0*D.s2*B.s3) + (D.s0*B.s2*C.s3) - (B.s3*C.s2*D.s0) - (C.s3*D.s2*B.s0) - (D.s3*B.s2*C.s0));
-    res += A.s2 * ((B.s0*C.s1*D.s3) + (C.s0*D.s1*B.s3) + (D.s0*B.s1*C.s3) - (B.s3*C.s1*D.s0) - (C.s3*D.s1*B.s0) - (D.s3*B.s1*C.s0));
-    res -= A.s3 * ((B.s0*C.s1*D.s2) + (C.s0*D.s1*B.s2) + (D.s0*B.s1*C.s2) - (B.s2*C.s1*D.s0) - (C.s2*D.s1*B.s0) - (D.s2*B.s1*C.s0));
-    return res;
+    float4 ab, cd;
+    float2 ab2, cd2;
+    minors4(A, B, &ab, &ab2);
+    minors4(C, D, &cd, &cd2);
+    return det4_minors(ab, ab2, cd, cd2);
+}
+
+// Cramer's rule for origin + t*dir = v0 + y*e1 + z*e2 + w*e3 with T = origin - v0.
+// returns det(dir, e1, e2, e3), num gets the numerators of (-t, y, z, w)
+float ray_tetra_cramer(float4 dir, float4 e1, float4 e2, float4 e3, float4 T, float4* num){
+    float4 e23, dT;
+    float2 e23b, dTb;
+    minors4(e2, e3, &e23, &e23b);
+    minors4(dir, T, &dT, &dTb);
+
+    float4 n = det4_first_row(e1, e23, e23b);
+    float4 g = det4_last_row(dT, dTb, e1);
+    *num = (float4)(dot(T, n), det4_minors(dT, dTb, e23, e23b), -dot(g, e3), dot(g, e2));
+    return dot(dir, n);
 }
 
 bool intersect_tetrahedron(const struct Tetrahedron* tetra, const struct Ray4* ray, float* t){
    
     float4 p = ray->origin + (ray->dir * (*t));
 
-    float detABCD = det4(tetra->v0, tetra->v1, tetra->v2, tetra->v3);
+    // all five determinants from the minors of (v0, v1) and (v2, v3)
+    float4 ab, cd;
+    float2 ab2, cd2;
+    minors4(tetra->v0, tetra->v1, &ab, &ab2);
+    minors4(tetra->v2, tetra->v3, &cd, &cd2);
 
-    float detPBCD = det4(p, tetra->v1, tetra->v2, tetra->v3);
-    float detAPCD = det4(tetra->v0, p, tetra->v2, tetra->v3);
-    float detABPD = det4(tetra->v0, tetra->v1, p, tetra->v3);
-    float detABCP = det4(tetra->v0, tetra->v1, tetra->v2, p);
+    float detABCD = det4_minors(ab, ab2, cd, cd2);
+
+    float detPBCD = dot(p, det4_first_row(tetra->v1, cd, cd2));
+    float detAPCD = -dot(p, det4_first_row(tetra->v0, cd, cd2));
+    float detABPD = dot(det4_last_row(ab, ab2, p), tetra->v3);
+    float detABCP = dot(det4_last_row(ab, ab2, tetra->v2), p);
 
     float x1 = detPBCD/detABCD;
     float x2 = detAPCD/detABCD;
@@ -110,16 +163,17 @@ struct Ray createCamRay(const int x_coord, const int y_coord, const int width, c
 struct Ray4 createCamRay4D(const int x_coord, const int y_coord, const int z_coord, const int width, const int height, const int depth) {
     float fx = (float)x_coord / (float)width;
     float fy = (float)y_coord / (float)height;
-    float fz = (float)z_coord;
+    float fz = (float)z_coord / (float)depth;
 
     float aspect_ratio = (float)width / (float)height;
     float fx2 = (fx - 0.5f) * aspect_ratio;
     float fy2 = fy - 0.5f;
+    float fz2 = fz - 0.5f;
 
-    float4 pixel_pos = (float4)(fx2, -fy2, fz, 0.0f);
+    float4 pixel_pos = (float4)(fx2, fy2, -fz2, 0.0f);
 
     struct Ray4 ray;
-    ray.origin = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+    ray.origin = (float4)(0.0f, 0.0f, 0.0f, 1.0f);
     ray.dir = normalize(pixel_pos - ray.origin);
 
     return ray;
@@ -152,6 +206,28 @@ bool intersect_triangle(const struct Triangle* triangle, const struct Ray* ray,
         return true;
 }
 
+// same edge based Cramer solve as intersect_tetrahedron in main.cpp
+bool intersect_tetra(float4 v0, float4 v1, float4 v2, float4 v3, const struct Ray4* ray, float* t){
+    float4 v0v1 = v1 - v0;
+    float4 v0v2 = v2 - v0;
+    float4 v0v3 = v3 - v0;
+    float4 Tvec = ray->origin - v0;
+
+    float4 M;
+    float detM = ray_tetra_cramer(ray->dir, v0v1, v0v2, v0v3, Tvec, &M);
+    if (fabs(detM) < epsilon) {return false;}
+
+    float invDet = 1.0f / detM;
+
+    float y = M.y * invDet;
+    float z = M.z * invDet;
+    float w = M.w * invDet;
+    if (y < 0 || z < 0 || w < 0 || y + z + w > 1) {return false;}
+
+    *t = -M.x * invDet;
+    return true;
+}
+
 bool intersect4d(const struct Ray4* ray, float *tnear, float3 *tetraMesh ){
     for (int i=0; i<sizeof(tetraMesh)/sizeof(float3); i++){
        struct Tetrahedron tetra;
@@ -188,4 +264,111 @@ __kernel void render_4d_to_3d(__global float3* cl_output, int width, int height,
 
 
     cl_output[id] = (float3)(0.0f, 0.0f, 0.0f);
-}
\ No newline at end of file
+}
+
+__kernel void quantize_output(__global const float3* cl_output, __global uchar* output256, int count){
+    const int id = get_global_id(0);
+    if (id >= count) {return;}
+
+    float3 color = clamp(cl_output[id], 0.0f, 1.0f) * 255.0f + 0.5f;
+    vstore3(convert_uchar3(color), id, output256);
+}
+
+
+// tetra_verts holds the 4 vertices of every tetrahedron back to back (see gatherTetraVertices)
+// number of work-items needed for `slices` z slices, see slab_voxel
+int slab_items(int ordering, int width, int height, int slices){
+    if (ordering == 0) {return width * height * slices;}
+    return ((width + 7) / 8) * ((height + 7) / 8) * 64 * slices;
+}
+
+// maps a work-item id inside a slab to voxel coordinates.
+// ordering 0 walks x fastest, ordering 1 walks 8x8 pixel tiles with Morton order inside
+// each tile, so the rays of a work-group stay close together.
+// returns false for ids that fall outside the image
+bool slab_voxel(int id, int ordering, int width, int height, int z_begin, int z_end, int* x, int* y, int* z){
+    if (id >= slab_items(ordering, width, height, z_end - z_begin)) {return false;}
+
+    if (ordering == 0){
+        int voxel = z_begin * width * height + id;
+        *x = voxel % width;
+        *z = voxel / (width*height);
+        *y = (voxel - (*z)*width*height) / width;
+        return true;
+    }
+
+    int tiles_x = (width + 7) / 8;
+    int tiles_y = (height + 7) / 8;
+    int tile = id / 64;
+    int m = id % 64;
+
+    *z = z_begin + tile / (tiles_x * tiles_y);
+    tile = tile % (tiles_x * tiles_y);
+    *x = (tile % tiles_x) * 8 + ((m & 1) | ((m >> 1) & 2) | ((m >> 2) & 4));
+    *y = (tile / tiles_x) * 8 + (((m >> 1) & 1) | ((m >> 2) & 2) | ((m >> 3) & 4));
+    return *x < width && *y < height;
+}
+
+// only the z slices [z_begin, z_end) are rendered, cl_output[0] is the first voxel of z_begin.
+// results are always written in linear order, whatever the ordering
+__kernel void render_4d_to_3d_mesh(__global float3* cl_output, __global const float4* tetra_verts, int vols, int width, int height, int depth, int z_begin, int z_end, int ordering){
+    const int id = get_global_id(0);
+
+    int x, y, z;
+    if (!slab_voxel(id, ordering, width, height, z_begin, z_end, &x, &y, &z)) {return;}
+    int out = (z - z_begin) * width * height + y * width + x;
+
+    struct Ray4 camray = createCamRay4D(x, y, z, width, height, depth);
+
+    float t_near = 1e20f;
+    int hit = -1;
+    for (int i = 0; i < vols; i++){
+        float t;
+        if (intersect_tetra(tetra_verts[4*i], tetra_verts[4*i+1], tetra_verts[4*i+2], tetra_verts[4*i+3], &camray, &t) && t < t_near){
+            t_near = t;
+            hit = i;
+        }
+    }
+
+    cl_output[out] = (hit >= 0) ? (float3)(1.0f, 1.0f, 1.0f) : (float3)(0.0f, 0.0f, 0.0f);
+}
+
+// same as render_4d_to_3d_mesh, but the work-group streams the mesh through local memory
+// in blocks of get_local_size(0) tetrahedra, so every tetra is read from global memory
+// once per work-group instead of once per work-item.
+// tile must hold 4 * get_local_size(0) float4.
+__kernel void render_4d_to_3d_local(__global float3* cl_output, __global const float4* tetra_verts, int vols, int width, int height, int depth, int z_begin, int z_end, int ordering, __local float4* tile){
+    const int id = get_global_id(0);
+    const int block = get_local_size(0);
+
+    // work-items outside the image still have to take part in the copies and barriers
+    int x = 0, y = 0, z = z_begin;
+    bool valid = slab_voxel(id, ordering, width, height, z_begin, z_end, &x, &y, &z);
+    x = min(x, width - 1);
+    y = min(y, height - 1);
+    z = min(z, z_end - 1);
+
+    struct Ray4 camray = createCamRay4D(x, y, z, width, height, depth);
+
+    float t_near = 1e20f;
+    int hit = -1;
+    for (int base = 0; base < vols; base += block){
+        int count = min(block, vols - base);
+
+        event_t copy = async_work_group_copy(tile, tetra_verts + 4*base, 4*count, 0);
+        wait_group_events(1, &copy);
+
+        for (int k = 0; k < count; k++){
+            float t;
+            if (intersect_tetra(tile[4*k], tile[4*k+1], tile[4*k+2], tile[4*k+3], &camray, &t) && t < t_near){
+                t_near = t;
+                hit = base + k;
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (valid){
+        cl_output[(z - z_begin) * width * height + y * width + x] = (hit >= 0) ? (float3)(1.0f, 1.0f, 1.0f) : (float3)(0.0f, 0.0f, 0.0f);
+    }
+}
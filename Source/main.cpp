@@ -10,6 +10,15 @@
 #include <vector>
 #include <cmath>
 #include <random>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <limits>
 
 #include <CL/opencl.hpp>
 #include <CL/cl.h>
@@ -18,9 +27,13 @@
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "../Header/stb_image_write.h"
-
-#define float3(x, y, z) {{x, y, z}} 
-#define float4(x, y, z, w) {{x, y, z, w}}
+#include "../Header/Philox.h"
+#include "../Header/TetraMesh.h"
+#include "../Header/TetraBVH.h"
+#include "../Header/TetraFile.h"
+#include "../Header/TetGenLoader.h"
+#include "../Header/TetraReorder.h"
+#include "../Header/TraceStats.h"
 
 
 
@@ -29,39 +42,80 @@ const int width = 50;
 const int height = 50;
 const int depth = 50;
 
-const float epsilon = 0.00003f;
 const float pi = 3.1415926535897932385;
 
-cl_float3 cpu_output[width * height]{};
+// binary mesh written by save_tetra_file, rendered instead of the built in mesh when set.
+// its AO is used when the file has it, otherwise computed like for the built in mesh
+std::string mesh_file = "";
+// TetGen mesh (TetGenLoader.h), basename of its .node and .ele, used when mesh_file is not set
+std::string tetgen_mesh = "";
+// loaded meshes are sorted along a 4D Hilbert curve (TetraReorder.h) before AO and the BVH
+bool reorder_mesh = true;
+// when set, the loaded mesh is written here with its AO and BVH, to be used as mesh_file next time
+std::string mesh_cache_out = "";
+
+// the coverage render also runs on every OpenCL device next to the native threads
+bool render_opencl = true;
+// OpenCL kernels, relative to the working directory or to the directory of this source file
+std::string kernel_file = "kernel.cl";
+
+// order the CPU renderers trace the voxels in, see voxelOrder. results are stored x fastest either way
+int voxel_ordering = 1;
+
+// AO rays start on a vertex, occluders closer than this are the vertex's own tetrahedra
+const float ao_ray_tmin = 1e-4f;
+
+// page aligned so they can back CL_MEM_USE_HOST_PTR buffers without a driver copy
+alignas(4096) cl_float3 cpu_output[width * height]{};
 //cl_float3 cpu_output_4d[width * height * depth]{};
-uint8_t output256[width * height * 3]{};
+alignas(4096) uint8_t output256[width * height * 3]{};
 
 cl::CommandQueue queue;
 cl::Kernel kernel;
+cl::Kernel quantize_kernel;
+cl::Kernel tetra_kernel;
+cl::Kernel tetra_local_kernel;
 cl::Context context;
 cl::Program program;
 cl::Buffer cl_output;
+cl::Buffer cl_output_bytes;
 cl::Buffer cl_spheres;
 
+// how cl_output gets back to the host:
+// OUTPUT_COPY          -> enqueueReadBuffer into cpu_output (discrete GPUs)
+// OUTPUT_ALLOC_HOST_PTR -> driver allocates host visible memory, result is mapped
+// OUTPUT_USE_HOST_PTR  -> cpu_output/output256 are the buffer storage, result is mapped
+// mapping is free on CPU and integrated GPU devices, so no copy happens there
+enum OutputMode { OUTPUT_COPY, OUTPUT_ALLOC_HOST_PTR, OUTPUT_USE_HOST_PTR };
+
+OutputMode output_mode = OUTPUT_ALLOC_HOST_PTR;
+// convert float colors to 8 bit on the device, the host then only touches final bytes
+bool quantize_on_device = true;
+size_t output_pixels = 0;
+
+
+bool readKernelSource(std::string& source) {
+    std::string source_dir = __FILE__;
+    source_dir = source_dir.substr(0, source_dir.find_last_of("\\/") + 1);
+
+    for (const std::string& path : { kernel_file, source_dir + kernel_file }) {
+        std::ifstream file(path);
+        if (!file) continue;
+        // keep the line breaks, otherwise comments swallow the rest of the kernel code
+        source.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        return true;
+    }
+    return false;
+}
 
-struct TriangleMesh {
-    std::vector<cl_float3> vertices;
-    std::vector<float> ao_values;
-    int faces;
-    std::vector<int> vertIndex;
-};
-
-struct TetraMesh {
-    std::vector<cl_float4> vertices;
-    std::vector<float> ao_values;
-    int vols;
-    std::vector<int> vertIndex;
-};
-
-struct Ray4 {
-    cl_float4 origin;
-    cl_float4 dir;
-};
+std::string loadKernelSource() {
+    std::string source;
+    if (!readKernelSource(source)) {
+        std::cout << "\nFile not found: " << kernel_file;
+        exit(1);
+    }
+    return source;
+}
 
 void initOpenCL() {
     // get all platforms (drivers), e.g. NVIDIA
@@ -94,17 +148,7 @@ void initOpenCL() {
     queue = cl::CommandQueue(context, device);
 
     //converet opencl kernel code to string
-    std::string source;
-    std::ifstream file("C:\\Users\\Lily\\Documents\\UNI\\BA\\programming\\Project\\Source\\kernel.cl");
-    if (!file) {
-        std::cout << "\nFile not found";
-        exit(1);
-    }
-    while (!file.eof()) {
-        char line[256];
-        file.getline(line, 255);
-        source += line;
-    }
+    std::string source = loadKernelSource();
 
     //create opencl program using source
     program = cl::Program(context, source.c_str());
@@ -115,6 +159,41 @@ void initOpenCL() {
     if (result == CL_BUILD_PROGRAM_FAILURE) std::cout << "CL Build Program Failure?" << std::endl;
 
     kernel = cl::Kernel(program, "render_triangle");
+    quantize_kernel = cl::Kernel(program, "quantize_output");
+    tetra_kernel = cl::Kernel(program, "render_4d_to_3d_mesh");
+    tetra_local_kernel = cl::Kernel(program, "render_4d_to_3d_local");
+}
+
+cl_mem_flags outputFlags(size_t bytes, size_t host_bytes, void*& host_ptr) {
+    host_ptr = NULL;
+    switch (output_mode) {
+    case OUTPUT_USE_HOST_PTR:
+        // the static host arrays only cover one image, fall back for anything bigger
+        if (bytes <= host_bytes) {
+            return CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR;
+        }
+        return CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR;
+    case OUTPUT_ALLOC_HOST_PTR:
+        return CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR;
+    default:
+        return CL_MEM_READ_WRITE;
+    }
+}
+
+// (re)create cl_output (and the 8 bit buffer) for the given number of pixels
+void initOutputBuffer(size_t pixels) {
+    output_pixels = pixels;
+
+    void* host_ptr;
+    cl_mem_flags flags = outputFlags(pixels * sizeof(cl_float3), sizeof(cpu_output), host_ptr);
+    if (flags & CL_MEM_USE_HOST_PTR) host_ptr = cpu_output;
+    cl_output = cl::Buffer(context, flags, pixels * sizeof(cl_float3), host_ptr);
+
+    if (quantize_on_device) {
+        flags = outputFlags(pixels * 3, sizeof(output256), host_ptr);
+        if (flags & CL_MEM_USE_HOST_PTR) host_ptr = output256;
+        cl_output_bytes = cl::Buffer(context, flags, pixels * 3, host_ptr);
+    }
 }
 
 float clamp(float x) { return x < 0.0f ? 0.0f : x > 1.0f ? 1.0f : x; }
@@ -122,41 +201,73 @@ float clamp(float x) { return x < 0.0f ? 0.0f : x > 1.0f ? 1.0f : x; }
 //convert RGB float in range [0, 1] to int in range [0, 255]
 int toInt(float x) { return int(clamp(x) * 255 + .5); }
 
-void saveImage(std::string filename, bool ppm = true, bool png = true) {
+void quantizeImage(const cl_float3* pixels, uint8_t* rgb, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        rgb[3 * i + 0] = toInt(pixels[i].s[0]);
+        rgb[3 * i + 1] = toInt(pixels[i].s[1]);
+        rgb[3 * i + 2] = toInt(pixels[i].s[2]);
+    }
+}
+
+void saveImageBytes(std::string filename, const uint8_t* rgb, bool ppm = true, bool png = true) {
     std::cout << "Saving image ...\n";
-    FILE* file;
 
     if (ppm) {
-        file = fopen((filename + ".ppm").c_str(), "w");
+        FILE* file = fopen((filename + ".ppm").c_str(), "w");
         fprintf(file, "P3\n%d %d\n%d\n", width, height, 255);
-    }
-
-    for (std::pair<int, int> i(0,0); i.first < width * height; i.first++) {
-
-        int r = toInt(cpu_output[i.first].s[0]);
-        int g = toInt(cpu_output[i.first].s[1]);
-        int b = toInt(cpu_output[i.first].s[2]);
-
-        if (ppm) {
-            fprintf(file, "%d %d %d ", r, g, b);
-        }
-
-        if (png) {
-            output256[i.second++] = r;
-            output256[i.second++] = g;
-            output256[i.second++] = b;
+        for (int i = 0; i < width * height * 3; i += 3) {
+            fprintf(file, "%d %d %d ", rgb[i], rgb[i + 1], rgb[i + 2]);
         }
-    }
-    if (ppm) {
         fclose(file);
         std::cout << "Finished writing PPM!\n";
     }
     if (png) {
-        stbi_write_png((filename + ".png").c_str(), width, height, 3, output256, width*3);
+        stbi_write_png((filename + ".png").c_str(), width, height, 3, rgb, width*3);
         std::cout << "Finished writing png!\n";
+    }
+}
+
+void saveImage(std::string filename, const cl_float3* pixels, bool ppm = true, bool png = true) {
+    quantizeImage(pixels, output256, width * height);
+    saveImageBytes(filename, output256, ppm, png);
+}
 
+void saveImage(std::string filename, bool ppm = true, bool png = true) {
+    saveImage(filename, cpu_output, ppm, png);
+}
+
+// fetch the first width*height pixels of cl_output and save them,
+// mapping instead of copying unless output_mode is OUTPUT_COPY
+void saveOpenCLImage(std::string filename, bool ppm = true, bool png = true) {
+    size_t pixels = width * height;
+
+    if (quantize_on_device) {
+        quantize_kernel.setArg(0, cl_output);
+        quantize_kernel.setArg(1, cl_output_bytes);
+        quantize_kernel.setArg(2, (int)pixels);
+        queue.enqueueNDRangeKernel(quantize_kernel, cl::NullRange, cl::NDRange(pixels));
+
+        if (output_mode == OUTPUT_COPY) {
+            queue.enqueueReadBuffer(cl_output_bytes, CL_TRUE, 0, pixels * 3, output256);
+            saveImageBytes(filename, output256, ppm, png);
+            return;
+        }
+        uint8_t* rgb = (uint8_t*)queue.enqueueMapBuffer(cl_output_bytes, CL_TRUE, CL_MAP_READ, 0, pixels * 3);
+        saveImageBytes(filename, rgb, ppm, png);
+        queue.enqueueUnmapMemObject(cl_output_bytes, rgb);
+        queue.finish();
+        return;
     }
 
+    if (output_mode == OUTPUT_COPY) {
+        queue.enqueueReadBuffer(cl_output, CL_TRUE, 0, pixels * sizeof(cl_float3), cpu_output);
+        saveImage(filename, cpu_output, ppm, png);
+        return;
+    }
+    cl_float3* mapped = (cl_float3*)queue.enqueueMapBuffer(cl_output, CL_TRUE, CL_MAP_READ, 0, pixels * sizeof(cl_float3));
+    saveImage(filename, mapped, ppm, png);
+    queue.enqueueUnmapMemObject(cl_output, mapped);
+    queue.finish();
 }
 
 void saveToBinary(std::string filename, std::vector<glm::vec3> data) {
@@ -183,94 +294,7 @@ void cleanUp() {
     delete cpu_output;
 }
 
-cl_float4 normalize(cl_float4 v) {
-    float length = std::sqrt(v.s0*v.s0 + v.s1 * v.s1 + v.s2 * v.s2 + v.s3 * v.s3);
-    return float4(v.s0 / length, v.s1 / length, v.s2 / length, v.s3 / length);
-}
-
-cl_float4 operator-(cl_float4 v, cl_float4 w) {
-    return float4(v.s0 - w.s0, v.s1 - w.s1, v.s2 - w.s2, v.s3 - w.s3);
-}
-
-cl_float4 operator+(cl_float4 v, cl_float4 w) {
-    return float4(v.s0 + w.s0, v.s1 + w.s1, v.s2 + w.s2, v.s3 + w.s3);
-}
-
-cl_float4 operator*(cl_float4 v, float t) {
-    return float4(t * v.s0, t * v.s1, t * v.s2, t * v.s3);
-}
-
-float dot(cl_float4 A, cl_float4 B) {
-    return A.s0 * B.s0 + A.s1 * B.s1 + A.s2 * B.s2 + A.s3 * B.s3;
-}
-
-
-float det4(cl_float4 A, cl_float4 B, cl_float4 C, cl_float4 D) {
-    float res = 0.0;
-    res += A.s0 * ((B.s1 * C.s2 * D.s3) + (C.s1 * D.s2 * B.s3) + (D.s1 * B.s2 * C.s3) - (B.s3 * C.s2 * D.s1) - (C.s3 * D.s2 * B.s1) - (D.s3 * B.s2 * C.s1));
-    res -= A.s1 * ((B.s0 * C.s2 * D.s3) + (C.s0 * D.s2 * B.s3) + (D.s0 * B.s2 * C.s3) - (B.s3 * C.s2 * D.s0) - (C.s3 * D.s2 * B.s0) - (D.s3 * B.s2 * C.s0));
-    res += A.s2 * ((B.s0 * C.s1 * D.s3) + (C.s0 * D.s1 * B.s3) + (D.s0 * B.s1 * C.s3) - (B.s3 * C.s1 * D.s0) - (C.s3 * D.s1 * B.s0) - (D.s3 * B.s1 * C.s0));
-    res -= A.s3 * ((B.s0 * C.s1 * D.s2) + (C.s0 * D.s1 * B.s2) + (D.s0 * B.s1 * C.s2) - (B.s2 * C.s1 * D.s0) - (C.s2 * D.s1 * B.s0) - (D.s2 * B.s1 * C.s0));
-    return res;
-}
-
-cl_float4 cross4(cl_float4 A, cl_float4 B, cl_float4 C) {
- 
-    float x =   ((A.s1 * B.s2 * C.s3) + (A.s2 * B.s3 * C.s1) + (A.s3 * B.s1 * C.s2) - (C.s1 * B.s2 * A.s3) - (C.s2 * B.s3 * A.s1) - (C.s3 * B.s1 * A.s2));
-    float y = - ((A.s0 * B.s2 * C.s3) + (A.s2 * B.s3 * C.s0) + (A.s3 * B.s0 * C.s2) - (C.s0 * B.s2 * A.s3) - (C.s2 * B.s3 * A.s0) - (C.s3 * B.s0 * A.s2));
-    float z =   ((A.s0 * B.s1 * C.s3) + (A.s1 * B.s3 * C.s0) + (A.s3 * B.s0 * C.s1) - (C.s0 * B.s1 * A.s3) - (C.s1 * B.s3 * A.s0) - (C.s3 * B.s0 * A.s1));
-    float w = - ((A.s0 * B.s1 * C.s2) + (A.s1 * B.s2 * C.s0) + (A.s2 * B.s0 * C.s1) - (C.s0 * B.s1 * A.s2) - (C.s1 * B.s2 * A.s0) - (C.s2 * B.s0 * A.s1));
-    return float4(x, y, z, w);
-}
-
-
-bool intersect_tetrahedron(cl_float4 v0, cl_float4 v1, cl_float4 v2, cl_float4 v3, Ray4 ray, float &t) {
-
-    cl_float4 v0v1 = v1 - v0;
-    cl_float4 v0v2 = v2 - v0;
-    cl_float4 v0v3 = v3 - v0;
-    cl_float4 Tvec = ray.origin - v0;
-    
-    //std::cout << ray.dir.s0 << " " << ray.dir.s1 << " " << ray.dir.s2 << " "  << ray.dir.s3 << std::endl;
-    //std::cout << v0v1.s0 << " " << v0v1.s1 << " " << v0v1.s2 << " " << v0v1.s3 << std::endl;
-    //std::cout << v0v2.s0 << " " << v0v2.s1 << " " << v0v2.s2 << " " << v0v2.s3 << std::endl;
-    //std::cout << v0v3.s0 << " " << v0v3.s1 << " " << v0v3.s2 << " " << v0v3.s3 << std::endl;
-
-    float detM = det4(ray.dir, v0v1, v0v2, v0v3);
-    //std::cout << "detM: " << detM << std::endl;
-
-    //if (detM < epsilon) { return false; }
-    if (std::fabs(detM) < epsilon) { return false; }
-
-    float invDet = 1 / detM;
-
-    float Mt = det4(Tvec,    v0v1, v0v2, v0v3);
-    float My = det4(ray.dir, Tvec, v0v2, v0v3);
-    float Mz = det4(ray.dir, v0v1, Tvec, v0v3);
-    float Mw = det4(ray.dir, v0v1, v0v2, Tvec);
-
-
-
-    t = Mt * invDet;
-
-    float y = My * invDet;
-
-    if (y < 0) { return false; }
-    
-    float z = Mz * invDet;
-
-    if (z < 0) { return false; }
-
-    float w = Mw * invDet;
-
-    if (w < 0 || y+z+w > 1) { return false; }
-
-    
-
-    return true;
-}
-
-Ray4 createCamRay4D(int x, int y, int z) {
+TetraRay createCamRay4D(int x, int y, int z) {
     //normalize coordinates
     float fx = (float)x / (float)width;
     float fy = (float)y / (float)height;
@@ -284,65 +308,42 @@ Ray4 createCamRay4D(int x, int y, int z) {
 
     cl_float4 pixel_pos = float4(fx2, fy2, -fz2, 0.0f);
 
-    struct Ray4 ray;
+    TetraRay ray;
     ray.origin = float4(0.0f, 0.0f, 0.0f, 1.0f);
     ray.dir = normalize(pixel_pos - ray.origin);
 
     return ray;
 }
 
-bool intersect_mesh(Ray4 ray, std::vector<cl_float4>vertices, int vol, int* vertIndex, int &tetraIndex) {
-    float t_old = 1e20;
-    float t_new = 1e20;
-    for (int i = 0; i < vol; i++) {
-        cl_float4 v0 = vertices[vertIndex[0 + i*4]];
-        cl_float4 v1 = vertices[vertIndex[1 + i * 4]];
-        cl_float4 v2 = vertices[vertIndex[2 + i * 4]];
-        cl_float4 v3 = vertices[vertIndex[3 + i * 4]];
-
-        
-        bool intersect = intersect_tetrahedron(v0, v1, v2, v3, ray, t_new);
-        //std::cout << "t: " << t << std::endl;
-        if (intersect) {
-            //std::cout << "intersects a tetrahedra!\n";
-            if (t_old > t_new){
-                t_old = t_new;
-                tetraIndex = i;
-            }
-            return true;
-        }
-    }
-    return false;
+bool intersect_mesh(TetraRay ray, const TetraMeshView& mesh, const TetraBVH& bvh, int& tetraIndex) {
+    float t;
+    return bvh.intersect(ray, mesh, tetraIndex, t);
 }
 
-bool intersect_mesh(Ray4 ray, TetraMesh mesh, int& tetraIndex) {
-    float t_old = 1e20;
-    float t_new = 1e20;
-    for (int i = 0; i < mesh.vols; i++) {
-        cl_float4 v0 = mesh.vertices[mesh.vertIndex[0 + i * 4]];
-        cl_float4 v1 = mesh.vertices[mesh.vertIndex[1 + i * 4]];
-        cl_float4 v2 = mesh.vertices[mesh.vertIndex[2 + i * 4]];
-        cl_float4 v3 = mesh.vertices[mesh.vertIndex[3 + i * 4]];
-
+// coverage of every voxel through the BVH against brute force intersect_mesh, returns the
+// number of voxels that differ. cheap enough on the built in mesh to run every time
+int checkBVHCoverage(const TetraMeshView& mesh, const TetraBVH& bvh) {
+    int covered = 0;
+    int differ = 0;
+    for (int i = 0; i < width * height * depth; i++) {
+        int x = i % width;
+        int z = i / (width * height);
+        int y = (i - (z * width * height)) / width;
 
-        bool intersect = intersect_tetrahedron(v0, v1, v2, v3, ray, t_new);
-        //std::cout << "t: " << t << std::endl;
-        if (intersect) {
-            //std::cout << "intersects a tetrahedra!\n";
-            if (t_old > t_new) {
-                t_old = t_new;
-                tetraIndex = i;
-            }
-            return true;
-        }
+        TetraRay camray = createCamRay4D(x, y, z);
+        TetraHit brute_hit, bvh_hit;
+        bool brute = intersect_mesh<CoverageQuery>(camray, mesh, brute_hit);
+        covered += brute;
+        differ += brute != bvh.intersect<CoverageQuery>(camray, mesh, bvh_hit);
     }
-    return false;
+    std::cout << "BVH check: " << differ << " of " << covered << " covered voxels differ from brute force" << std::endl;
+    return differ;
 }
 
-float random_angle(float min, float max) {
-    float random = ((float)rand()) / (float)RAND_MAX;
+// maps a uniform number u in [0,1) to [min, max)
+float random_angle(float min, float max, float u) {
     float diff = max - min;
-    float res = random * diff;
+    float res = u * diff;
     return min + res;
 }
 
@@ -356,16 +357,19 @@ cl_float4 point_in_sphere_4d(cl_float4 center, float radius, float theta, float
     return float4(x, y, z, w);
 }
 
-cl_float4 sample_hemisphere(cl_float4 center, float radius, cl_float4 normal) {
+// the random angles come from Philox indexed by (vertex, sample, pass), with one stream per
+// rejected attempt, so every sample can be drawn independently on any thread
+cl_float4 sample_hemisphere(cl_float4 center, float radius, cl_float4 normal, uint32_t vertex, uint32_t sample, uint32_t pass) {
     
-    while (true) {
-        float theta = random_angle(0, pi);
-        float phi = random_angle(0, 2 * pi);
-        float psi = random_angle(0, pi);
+    for (uint32_t attempt = 0; ; attempt++) {
+        float u[4];
+        random_uniform4(vertex, sample, pass, attempt, u);
+        float theta = random_angle(0, pi, u[0]);
+        float phi = random_angle(0, 2 * pi, u[1]);
+        float psi = random_angle(0, pi, u[2]);
 
         cl_float4 sample = point_in_sphere_4d(center, radius, theta, phi, psi);
         if (dot(sample, normal) > 0) {
-            std::cout << "sample found!" << std::endl;
             return sample;
         }
 
@@ -373,61 +377,54 @@ cl_float4 sample_hemisphere(cl_float4 center, float radius, cl_float4 normal) {
 }
 
 
-std::vector<float> get_ao4d(TetraMesh mesh, float radius, int samples) {
-    std::vector<float> ao_values(mesh.vertices.size());
-
-    for (int i = 0; i < mesh.vols; i++) {
-        cl_float4 v0 = mesh.vertices[mesh.vertIndex[0 + i * 4]];
-        cl_float4 v1 = mesh.vertices[mesh.vertIndex[1 + i * 4]];
-        cl_float4 v2 = mesh.vertices[mesh.vertIndex[2 + i * 4]];
-        cl_float4 v3 = mesh.vertices[mesh.vertIndex[3 + i * 4]];
-
-        cl_float4 tetraVertex[4] = { v0, v1, v2, v3 };
-        int index[4] = { mesh.vertIndex[0 + i * 4], mesh.vertIndex[1 + i * 4], mesh.vertIndex[2 + i * 4], mesh.vertIndex[3 + i * 4] };
-
-        cl_float4 normal = cross4(v1 - v0, v2 - v0, v3 - v0);
 
-        for (int j = 0; j < 4; j++) {
-            cl_float4 vertex = tetraVertex[j];
-            int vertexIndex = index[j];
-
-            float ao = 0.0f;
-            Ray4 ray;
-            ray.origin = vertex;
-            int k = 0;
-            int counter = 0;
-
-            for (int l = 0; l < samples; l++) {
-                std::cout << "sample no. " << l << std::endl;
-                ray.dir = sample_hemisphere(vertex, radius, normal);
-               
-                if (intersect_mesh(ray, mesh, k)) {
-                    ao += 1.0;
-                }
-            }
-            ao_values[vertexIndex] = ao / samples;
-        }
+// bits 0..20 of v moved to bits 0, 3, 6, .. 60
+uint64_t spreadBits3(uint32_t v) {
+    uint64_t x = v & 0x1FFFFF;
+    x = (x | (x << 32)) & 0x001F00000000FFFFull;
+    x = (x | (x << 16)) & 0x001F0000FF0000FFull;
+    x = (x | (x << 8)) & 0x100F00F00F00F00Full;
+    x = (x | (x << 4)) & 0x10C30C30C30C30C3ull;
+    x = (x | (x << 2)) & 0x1249249249249249ull;
+    return x;
+}
 
-        return ao_values;
+// linear indices (x fastest) of the voxels of the z slices [z_begin, z_end) in the order
+// they are traced. ordering 0 is the linear order itself, ordering 1 is 3D Morton order:
+// consecutive rays then stay in a small brick of the volume instead of sweeping whole
+// scanlines, so they run through the same BVH nodes and tetrahedra while those are cached
+std::vector<int> voxelOrder(int ordering, int z_begin, int z_end) {
+    std::vector<int> order((size_t)width * height * (z_end - z_begin));
+    for (size_t n = 0; n < order.size(); n++) order[n] = z_begin * width * height + (int)n;
+    if (ordering == 0) return order;
+
+    std::vector<std::pair<uint64_t, int>> keyed(order.size());
+    for (size_t n = 0; n < order.size(); n++) {
+        int i = order[n];
+        int x = i % width;
+        int z = i / (width * height);
+        int y = (i - (z * width * height)) / width;
+        keyed[n] = std::make_pair(spreadBits3(x) | (spreadBits3(y) << 1) | (spreadBits3(z - z_begin) << 2), i);
     }
+    std::sort(keyed.begin(), keyed.end());
+    for (size_t n = 0; n < order.size(); n++) order[n] = keyed[n].second;
+    return order;
 }
 
-std::vector<glm::vec3> render4d_to_3d_glm(TetraMesh mesh) {
+// bvh is the tree of mesh, from its mesh file or built
+std::vector<glm::vec3> render4d_to_3d_glm(const TetraMeshView& mesh, const TetraBVH& bvh, int ordering = voxel_ordering) {
     std::vector<glm::vec3> data(width * height * depth);
 
-    for (int i = 0; i < width * height * depth; i++) {
+    for (int i : voxelOrder(ordering, 0, depth)) {
         int x = i % width;
         int z = i / (width * height);
         int y = (i - (z * width * height)) / width;
         //std::cout <<"Coordinates: " << x << " " << y << " " << z << std::endl;
 
-        Ray4 camray = createCamRay4D(x, y, z);
-        int tetraIndex = -1;
-        if (intersect_mesh(camray, mesh, tetraIndex)) {
+        TetraRay camray = createCamRay4D(x, y, z);
+        TetraHit hit;
+        if (bvh.intersect<CoverageQuery>(camray, mesh, hit)) {
 
-            if (tetraIndex != -1) {
-                //std::cout << tetraIndex << std::endl;
-            }
             data[i] = glm::vec3(1.0f, 1.0f, 1.0f);
             //std::cout << data[i].x << data[i].y << data[i].z << std::endl;
         }
@@ -439,22 +436,20 @@ std::vector<glm::vec3> render4d_to_3d_glm(TetraMesh mesh) {
     return data;
 }
 
-std::vector<glm::vec3> render4d_ao_to_3d_glm(TetraMesh mesh, bool min1 = true) {
+std::vector<glm::vec3> render4d_ao_to_3d_glm(const TetraMeshView& mesh, const TetraBVH& bvh, bool min1 = true, int ordering = voxel_ordering) {
     std::vector<glm::vec3> data(width * height * depth);
 
-    for (int i = 0; i < width * height * depth; i++) {
+    for (int i : voxelOrder(ordering, 0, depth)) {
         int x = i % width;
         int z = i / (width * height);
         int y = (i - (z * width * height)) / width;
         //std::cout <<"Coordinates: " << x << " " << y << " " << z << std::endl;
 
-        Ray4 camray = createCamRay4D(x, y, z);
-        int tetraIndex = -1;
-        if (intersect_mesh(camray, mesh, tetraIndex)) {
+        TetraRay camray = createCamRay4D(x, y, z);
+        TetraHit hit;
+        if (bvh.intersect<ShadingQuery>(camray, mesh, hit, 0.0f, std::numeric_limits<float>::max())) {
+            int tetraIndex = hit.tetra;
 
-            if (tetraIndex != -1) {
-                //std::cout << tetraIndex << std::endl;
-            }
             ///*
             float ao0 = mesh.ao_values[mesh.vertIndex[0 + tetraIndex * 4]];
             float ao1 = mesh.ao_values[mesh.vertIndex[1 + int(tetraIndex * 4)]];
@@ -484,42 +479,604 @@ std::vector<glm::vec3> render4d_ao_to_3d_glm(TetraMesh mesh, bool min1 = true) {
 }
 
 
+// box and primitive tests of every voxel's ray through bvh, as a gray volume scaled to the
+// most expensive voxel: the bright parts of the mesh are where the time goes.
+// needs TRACE_STATS, without it every voxel is 0
+std::vector<glm::vec3> render4d_cost_to_3d_glm(const TetraMeshView& mesh, const TetraBVH& bvh, int ordering = voxel_ordering) {
+    std::vector<uint64_t> cost(width * height * depth);
+    uint64_t max_cost = 1;
+
+    for (int i : voxelOrder(ordering, 0, depth)) {
+        int x = i % width;
+        int z = i / (width * height);
+        int y = (i - (z * width * height)) / width;
+
+        TetraRay camray = createCamRay4D(x, y, z);
+        TetraHit hit;
+        uint64_t before = thread_trace_stats().tests();
+        bvh.intersect<ShadingQuery>(camray, mesh, hit);
+        cost[i] = thread_trace_stats().tests() - before;
+        max_cost = std::max(max_cost, cost[i]);
+    }
+
+    std::cout << "Most expensive voxel: " << max_cost << " tests" << std::endl;
+    std::vector<glm::vec3> data(cost.size());
+    for (size_t i = 0; i < cost.size(); i++) {
+        float heat = (float)cost[i] / (float)max_cost;
+        data[i] = glm::vec3(heat, heat, heat);
+    }
+    return data;
+}
+
+// flatten the mesh into 4 vertices per tetrahedron so a kernel can read (or stage) a
+// tetra with contiguous loads instead of going through vertIndex
+std::vector<cl_float4> gatherTetraVertices(const TetraMeshView& mesh) {
+    std::vector<cl_float4> tetra_verts(mesh.vols * 4);
+    for (int i = 0; i < mesh.vols * 4; i++) {
+        tetra_verts[i] = mesh.vertices[mesh.vertIndex[i]];
+    }
+    return tetra_verts;
+}
+
+// the flattened tetra vertices of mesh: the ones stored in its mesh file where they are,
+// otherwise gathered into storage
+const cl_float4* tetraVertices(const TetraMeshView& mesh, std::vector<cl_float4>& storage) {
+    if (mesh.tetra_vertices) return mesh.tetra_vertices;
+    storage = gatherTetraVertices(mesh);
+    return storage.data();
+}
+
+// number of work-items the tetra kernels need for `slices` z slices (slab_items in kernel.cl)
+size_t slabItems(int ordering, int slices) {
+    if (ordering == 0) return (size_t)width * height * slices;
+    return (size_t)((width + 7) / 8) * ((height + 7) / 8) * 64 * slices;
+}
+
+// copy the first `voxels` entries of cl_output into glm vectors, mapping unless output_mode is OUTPUT_COPY
+std::vector<glm::vec3> readOutputVolume(size_t voxels) {
+    std::vector<glm::vec3> data(voxels);
+    std::vector<cl_float3> copy;
+    const cl_float3* pixels;
+
+    if (output_mode == OUTPUT_COPY) {
+        copy.resize(voxels);
+        queue.enqueueReadBuffer(cl_output, CL_TRUE, 0, voxels * sizeof(cl_float3), copy.data());
+        pixels = copy.data();
+    }
+    else {
+        pixels = (const cl_float3*)queue.enqueueMapBuffer(cl_output, CL_TRUE, CL_MAP_READ, 0, voxels * sizeof(cl_float3));
+    }
+
+    for (size_t i = 0; i < voxels; i++) {
+        data[i] = glm::vec3(pixels[i].s[0], pixels[i].s[1], pixels[i].s[2]);
+    }
+
+    if (output_mode != OUTPUT_COPY) {
+        queue.enqueueUnmapMemObject(cl_output, (void*)pixels);
+        queue.finish();
+    }
+    return data;
+}
+
+// OpenCL version of render4d_to_3d_glm, needs initOpenCL().
+// stream_local selects the kernel that shares blocks of tetrahedra through local memory,
+// ordering 1 walks the rays in Morton ordered 8x8 tiles instead of scanlines
+std::vector<glm::vec3> render4d_to_3d_opencl(const TetraMeshView& mesh, bool stream_local = true, size_t local_size = 64, int ordering = 0) {
+    size_t voxels = width * height * depth;
+    std::vector<cl_float4> gathered;
+    const cl_float4* tetra_verts = tetraVertices(mesh, gathered);
+
+    cl::Buffer cl_tetra_verts(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, (size_t)mesh.vols * 4 * sizeof(cl_float4), (void*)tetra_verts);
+    initOutputBuffer(voxels);
+
+    cl::Kernel& k = stream_local ? tetra_local_kernel : tetra_kernel;
+    k.setArg(0, cl_output);
+    k.setArg(1, cl_tetra_verts);
+    k.setArg(2, mesh.vols);
+    k.setArg(3, width);
+    k.setArg(4, height);
+    k.setArg(5, depth);
+    k.setArg(6, 0);
+    k.setArg(7, depth);
+    k.setArg(8, ordering);
+
+    // the local kernel needs a fixed group size to know its block size
+    size_t items = slabItems(ordering, depth);
+    size_t global_size = (items + local_size - 1) / local_size * local_size;
+    if (stream_local) {
+        k.setArg(9, cl::Local(4 * local_size * sizeof(cl_float4)));
+        queue.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(global_size), cl::NDRange(local_size));
+    }
+    else {
+        queue.enqueueNDRangeKernel(k, cl::NullRange, cl::NDRange(items));
+    }
+    queue.finish();
+
+    return readOutputVolume(voxels);
+}
+
+// ---- heterogeneous rendering: every OpenCL device plus native CPU threads ----
+
+// a participant in a scheduled render, renders z slices [z_begin, z_end) into data,
+// which always points at the whole volume in linear (x fastest) order
+class RenderBackend {
+public:
+    virtual ~RenderBackend() {}
+    virtual std::string name() const = 0;
+    virtual void render_slab(int z_begin, int z_end, glm::vec3* data) = 0;
+    // smallest slab worth launching, GPUs need a few slices to fill up
+    virtual int min_slab() const { return 1; }
+};
+
+// launch configuration of an OpenCL backend, found by autotuneBackend
+struct TuneConfig {
+    size_t local_size = 64;
+    int slab_height = 1;
+    int ordering = 0;   // 0 = scanlines, 1 = Morton ordered 8x8 tiles
+};
+
+// per device tuning results, written when autotune is on and read by every scheduled render
+std::string tuning_file = "opencl_tuning.txt";
+bool autotune = false;
+
+class CpuBackend : public RenderBackend {
+public:
+    CpuBackend(const TetraMeshView& m, const TetraBVH& b, int id) : mesh(m), bvh(b), thread_id(id) {}
+
+    virtual std::string name() const override { return "CPU thread " + std::to_string(thread_id); }
+
+    virtual void render_slab(int z_begin, int z_end, glm::vec3* data) override {
+        for (int i : voxelOrder(voxel_ordering, z_begin, z_end)) {
+            int x = i % width;
+            int z = i / (width * height);
+            int y = (i - (z * width * height)) / width;
+
+            TetraRay camray = createCamRay4D(x, y, z);
+            TetraHit hit;
+            data[i] = bvh.intersect<CoverageQuery>(camray, mesh, hit) ? glm::vec3(1.0f, 1.0f, 1.0f) : glm::vec3(0.0f, 0.0f, 0.0f);
+        }
+        TRACE_STAT(trace_stats_flush());
+    }
+
+private:
+    TetraMeshView mesh;
+    const TetraBVH& bvh;
+    int thread_id;
+};
+
+// one OpenCL device with its own context, queue and program
+class OpenCLBackend : public RenderBackend {
+public:
+    // tetra_verts holds 4 vertices per tetrahedron, it is copied to the device
+    OpenCLBackend(cl::Device dev, const std::string& source, const cl_float4* tetra_verts, int tetra_count)
+        : device(dev), vols(tetra_count), valid(false)
+    {
+        context = cl::Context(device);
+        queue = cl::CommandQueue(context, device);
+        program = cl::Program(context, source.c_str());
+        if (program.build({ device })) {
+            std::cout << "Error during compilation OpenCL code for " << name() << ", skipping device\n";
+            return;
+        }
+        kernel = cl::Kernel(program, "render_4d_to_3d_local");
+
+        cl_tetra_verts = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, (size_t)tetra_count * 4 * sizeof(cl_float4), (void*)tetra_verts);
+
+        // map instead of copy where device and host share memory
+        mapped = device.getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>() != CL_FALSE;
+        cl_mem_flags flags = mapped ? CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR : CL_MEM_READ_WRITE;
+        cl_slab = cl::Buffer(context, flags, width * height * depth * sizeof(cl_float3));
+        valid = true;
+    }
+
+    bool ok() const { return valid; }
+
+    void configure(const TuneConfig& c) { config = c; }
+
+    // largest work-group the kernel and the tetra tile in local memory allow
+    size_t max_local_size() const {
+        size_t by_kernel = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+        size_t by_memory = (size_t)device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>() / (4 * sizeof(cl_float4));
+        return std::min(by_kernel, by_memory);
+    }
+
+    virtual std::string name() const override { return device.getInfo<CL_DEVICE_NAME>(); }
+
+    virtual int min_slab() const override { return config.slab_height; }
+
+    virtual void render_slab(int z_begin, int z_end, glm::vec3* data) override {
+        size_t voxels = (size_t)(z_end - z_begin) * width * height;
+
+        kernel.setArg(0, cl_slab);
+        kernel.setArg(1, cl_tetra_verts);
+        kernel.setArg(2, vols);
+        kernel.setArg(3, width);
+        kernel.setArg(4, height);
+        kernel.setArg(5, depth);
+        kernel.setArg(6, z_begin);
+        kernel.setArg(7, z_end);
+        kernel.setArg(8, config.ordering);
+        kernel.setArg(9, cl::Local(4 * config.local_size * sizeof(cl_float4)));
+        size_t items = slabItems(config.ordering, z_end - z_begin);
+        size_t global_size = (items + config.local_size - 1) / config.local_size * config.local_size;
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(global_size), cl::NDRange(config.local_size));
+
+        glm::vec3* out = data + (size_t)z_begin * width * height;
+        if (mapped) {
+            cl_float3* pixels = (cl_float3*)queue.enqueueMapBuffer(cl_slab, CL_TRUE, CL_MAP_READ, 0, voxels * sizeof(cl_float3));
+            for (size_t i = 0; i < voxels; i++) out[i] = glm::vec3(pixels[i].s[0], pixels[i].s[1], pixels[i].s[2]);
+            queue.enqueueUnmapMemObject(cl_slab, pixels);
+            queue.finish();
+        }
+        else {
+            std::vector<cl_float3> pixels(voxels);
+            queue.enqueueReadBuffer(cl_slab, CL_TRUE, 0, voxels * sizeof(cl_float3), pixels.data());
+            for (size_t i = 0; i < voxels; i++) out[i] = glm::vec3(pixels[i].s[0], pixels[i].s[1], pixels[i].s[2]);
+        }
+    }
+
+private:
+    cl::Device device;
+    cl::Context context;
+    cl::CommandQueue queue;
+    cl::Program program;
+    cl::Kernel kernel;
+    cl::Buffer cl_tetra_verts;
+    cl::Buffer cl_slab;
+    int vols;
+    TuneConfig config;
+    bool mapped;
+    bool valid;
+};
+
+// benchmark every combination of work-group size, slab height and ray ordering on a few
+// slices from the middle of the volume, configure the backend with the fastest and return it
+TuneConfig autotuneBackend(OpenCLBackend& backend) {
+    const size_t local_sizes[] = { 16, 32, 64, 128, 256 };
+    const int slab_heights[] = { 1, 2, 4, 8, 16 };
+
+    std::vector<glm::vec3> scratch(width * height * depth);
+    int slices = std::min(depth, 16);
+    int z_first = (depth - slices) / 2;
+
+    TuneConfig best;
+    double best_seconds = std::numeric_limits<double>::infinity();
+
+    for (size_t local_size : local_sizes) {
+        if (local_size > backend.max_local_size()) continue;
+        for (int slab_height : slab_heights) {
+            if (slab_height > slices) continue;
+            for (int ordering = 0; ordering < 2; ordering++) {
+                TuneConfig config;
+                config.local_size = local_size;
+                config.slab_height = slab_height;
+                config.ordering = ordering;
+                backend.configure(config);
+
+                // warm up, the first launch pays for compilation and buffer setup
+                backend.render_slab(z_first, z_first + slab_height, scratch.data());
+
+                auto start = std::chrono::steady_clock::now();
+                for (int z = z_first; z < z_first + slices; z += slab_height) {
+                    backend.render_slab(z, std::min(z + slab_height, z_first + slices), scratch.data());
+                }
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                if (seconds < best_seconds) {
+                    best_seconds = seconds;
+                    best = config;
+                }
+            }
+        }
+    }
+
+    std::cout << "Tuned " << backend.name() << ": local size " << best.local_size << ", slab " << best.slab_height
+              << ", " << (best.ordering ? "morton" : "linear") << " (" << best_seconds / slices << "s per slice)\n";
+    backend.configure(best);
+    return best;
+}
+
+// tuning file: one device per line, "local_size slab_height ordering device name"
+std::map<std::string, TuneConfig> loadTuning(const std::string& filename) {
+    std::map<std::string, TuneConfig> tuning;
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        TuneConfig config;
+        std::string name;
+        if (fields >> config.local_size >> config.slab_height >> config.ordering && std::getline(fields >> std::ws, name)) {
+            tuning[name] = config;
+        }
+    }
+    return tuning;
+}
+
+void saveTuning(const std::string& filename, const std::map<std::string, TuneConfig>& tuning) {
+    std::ofstream file(filename);
+    if (!file) {
+        std::cout << "Cannot open file!\n";
+        return;
+    }
+    for (const auto& entry : tuning) {
+        file << entry.second.local_size << " " << entry.second.slab_height << " " << entry.second.ordering << " " << entry.first << "\n";
+    }
+}
+
+// hands out z-slabs of the output volume, or blocks of any other range like the vertices of
+// the AO bake. each participant asks with its own measured throughput, so the slab takes
+// about target_seconds on it: fast devices get big slabs, slow ones small. near the end
+// slabs shrink so nobody holds up the finish.
+class SlabScheduler {
+public:
+    SlabScheduler(int slices, int participant_count, double target = 0.05)
+        : next_z(0), depth(slices), participants(participant_count), target_seconds(target) {}
+
+    // slices_per_second == 0 means "not measured yet" and hands out min_slab slices
+    bool next(double slices_per_second, int min_slab, int& z_begin, int& z_end) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (next_z >= depth) return false;
+
+        int remaining = depth - next_z;
+        int slab = (int)(slices_per_second * target_seconds);
+        slab = std::min(slab, remaining / participants);
+        slab = std::max(slab, std::max(min_slab, 1));
+        slab = std::min(slab, remaining);
+
+        z_begin = next_z;
+        z_end = next_z + slab;
+        next_z = z_end;
+        return true;
+    }
+
+private:
+    std::mutex lock;
+    int next_z;
+    int depth;
+    int participants;
+    double target_seconds;
+};
+
+// AO of every vertex: the fraction of `samples` rays into the hemisphere around the normal of
+// the (last) tetrahedron using it that hit the mesh. vertices go out in blocks from a
+// SlabScheduler to `threads` native threads (0 = every core); the samples are indexed by
+// (vertex, sample, pass), so the result does not depend on which thread takes which block.
+// vertices no tetrahedron uses get 0
+std::vector<float> get_ao4d(const TetraMeshView& mesh, const TetraBVH& bvh, float radius, int samples, int pass = 0, int threads = 0) {
+    std::vector<float> ao_values(mesh.vertex_count, 0.0f);
+
+    // the tetrahedron each vertex takes its normal from
+    std::vector<int> owner(mesh.vertex_count, -1);
+    for (int i = 0; i < mesh.vols * 4; i++) {
+        owner[mesh.vertIndex[i]] = i / 4;
+    }
+
+    if (threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency());
+    SlabScheduler scheduler(mesh.vertex_count, threads);
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&]() {
+            double vertices_per_second = 0.0;
+            int begin, end;
+            while (scheduler.next(vertices_per_second, 64, begin, end)) {
+                auto start = std::chrono::steady_clock::now();
+                for (int vertexIndex = begin; vertexIndex < end; vertexIndex++) {
+                    int tetra = owner[vertexIndex];
+                    if (tetra < 0) continue;
+
+                    cl_float4 v0 = mesh.vertices[mesh.vertIndex[0 + tetra * 4]];
+                    cl_float4 v1 = mesh.vertices[mesh.vertIndex[1 + tetra * 4]];
+                    cl_float4 v2 = mesh.vertices[mesh.vertIndex[2 + tetra * 4]];
+                    cl_float4 v3 = mesh.vertices[mesh.vertIndex[3 + tetra * 4]];
+                    cl_float4 normal = cross4(v1 - v0, v2 - v0, v3 - v0);
+
+                    cl_float4 vertex = mesh.vertices[vertexIndex];
+                    TetraRay ray;
+                    ray.origin = vertex;
+                    TetraHit hit;
+                    float ao = 0.0f;
+                    TRACE_STAT(thread_trace_stats().ao_vertices++);
+                    TRACE_STAT(thread_trace_stats().ao_rays += samples);
+
+                    for (int l = 0; l < samples; l++) {
+                        ray.dir = sample_hemisphere(vertex, radius, normal, vertexIndex, l, pass);
+
+                        // any hit in front of the vertex, the tetrahedra it belongs to are hit at t = 0
+                        if (bvh.intersect<OcclusionQuery>(ray, mesh, hit, ao_ray_tmin, std::numeric_limits<float>::max())) {
+                            ao += 1.0;
+                        }
+                    }
+                    ao_values[vertexIndex] = ao / samples;
+                }
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                double measured = (end - begin) / std::max(seconds, 1e-6);
+                vertices_per_second = vertices_per_second == 0.0 ? measured : 0.5 * vertices_per_second + 0.5 * measured;
+            }
+            TRACE_STAT(trace_stats_flush());
+        }));
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    return ao_values;
+}
+
+// render4d_to_3d_glm spread over every OpenCL device of every platform plus a pool of native
+// threads, all working on the same volume.
+// cpu_threads < 0 uses the cores not already needed to drive OpenCL devices,
+// OpenCL CPU devices are skipped by default because they compete with the native threads.
+// devices use their entry from tuning_file, or get tuned first when autotune is set.
+// bvh is the tree of a mesh file (TetraFile::to_bvh), without one the native threads build it
+std::vector<glm::vec3> render4d_to_3d_scheduled(const TetraMeshView& mesh, int cpu_threads = -1, bool use_opencl = true, bool use_opencl_cpu = false,
+                                                const TetraBVH* bvh = nullptr) {
+    std::vector<glm::vec3> data(width * height * depth);
+    std::vector<std::unique_ptr<RenderBackend>> backends;
+
+    if (use_opencl) {
+        std::map<std::string, TuneConfig> tuning = loadTuning(tuning_file);
+
+        // the kernels and the tetra vertices are only prepared once there is a device to use
+        std::vector<cl_float4> gathered;
+        const cl_float4* tetra_verts = nullptr;
+        std::string source;
+        bool source_missing = false;
+
+        std::vector<cl::Platform> all_platforms;
+        cl::Platform::get(&all_platforms);
+        for (cl::Platform& platform : all_platforms) {
+            std::vector<cl::Device> all_devices;
+            platform.getDevices(CL_DEVICE_TYPE_ALL, &all_devices);
+            for (cl::Device& device : all_devices) {
+                if (!use_opencl_cpu && (device.getInfo<CL_DEVICE_TYPE>() & CL_DEVICE_TYPE_CPU)) continue;
+
+                if (source.empty()) {
+                    if (!readKernelSource(source)) {
+                        std::cout << "Warning: " << kernel_file << " not found, rendering on the native threads only\n";
+                        source_missing = true;
+                        break;
+                    }
+                    tetra_verts = tetraVertices(mesh, gathered);
+                }
+
+                std::unique_ptr<OpenCLBackend> backend(new OpenCLBackend(device, source, tetra_verts, mesh.vols));
+                if (!backend->ok()) continue;
+
+                if (autotune) {
+                    tuning[backend->name()] = autotuneBackend(*backend);
+                }
+                else if (tuning.count(backend->name())) {
+                    backend->configure(tuning[backend->name()]);
+                }
+                backends.push_back(std::move(backend));
+            }
+            if (source_missing) break;
+        }
+
+        if (autotune) saveTuning(tuning_file, tuning);
+    }
+
+    if (cpu_threads < 0) {
+        int cores = (int)std::thread::hardware_concurrency();
+        cpu_threads = std::max(1, cores - (int)backends.size());
+    }
+    TetraBVH built_bvh;
+    if (!bvh && cpu_threads > 0) {
+        built_bvh = TetraBVH(mesh);
+        bvh = &built_bvh;
+    }
+    for (int i = 0; i < cpu_threads; i++) {
+        backends.push_back(std::unique_ptr<RenderBackend>(new CpuBackend(mesh, *bvh, i)));
+    }
+
+    SlabScheduler scheduler(depth, (int)backends.size());
+    std::vector<int> slices_done(backends.size(), 0);
+    std::vector<double> seconds_busy(backends.size(), 0.0);
+
+    std::vector<std::thread> workers;
+    for (size_t b = 0; b < backends.size(); b++) {
+        workers.push_back(std::thread([&, b]() {
+            double slices_per_second = 0.0;
+            int z_begin, z_end;
+            while (scheduler.next(slices_per_second, backends[b]->min_slab(), z_begin, z_end)) {
+                auto start = std::chrono::steady_clock::now();
+                backends[b]->render_slab(z_begin, z_end, data.data());
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                // smooth the estimate, the first slab also pays for warm up
+                double measured = (z_end - z_begin) / std::max(seconds, 1e-6);
+                slices_per_second = slices_per_second == 0.0 ? measured : 0.5 * slices_per_second + 0.5 * measured;
+
+                slices_done[b] += z_end - z_begin;
+                seconds_busy[b] += seconds;
+            }
+        }));
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    for (size_t b = 0; b < backends.size(); b++) {
+        std::cout << backends[b]->name() << ": " << slices_done[b] << " slices in " << seconds_busy[b] << "s\n";
+    }
+    return data;
+}
 
 int main() {
 
     //init scene
     TetraMesh mesh;
+    TetraFile mesh_cache;
+    if (!mesh_file.empty() && mesh_cache.open(mesh_file)) {
+        std::cout << "Mapped " << mesh_cache.vertex_count() << " points, " << mesh_cache.tetra_count() << " tetrahedra from " << mesh_file << std::endl;
+    }
+    else if (!tetgen_mesh.empty() && load_tetgen(tetgen_mesh, mesh)) {
+        std::cout << "Loaded " << mesh.vertices.size() << " points, " << mesh.vols << " tetrahedra from " << tetgen_mesh << std::endl;
+        // a mesh file is stored sorted already
+        if (reorder_mesh) reorder_tetra_mesh(mesh);
+    }
+    else {
+        mesh.vertices = {
+                            float4(-0.25, 0.0, 0.0, 0.0), //0
+                            float4(-0.25, 0.25,-0.25, 0.0),//1 
+                            float4(-0.3, 0.0, 0.5, 0.0), //2
+                            float4(-0.5, 0.0, 0.0, 0.0), //3
+
+                            float4(-0.5, 0.25, 0.0, 0.5), //4
+                            float4(-0.35, 0.25, -0.25, 0.5), //5
+                            float4(0.25, 0.0, 0.0, 0.0), //6
+                            float4(0.5, 0.0, 0.0, 0.0) //7
+        };
+
+        mesh.vols = 2;
+        mesh.vertIndex = { 0, 1, 2, 3, 4, 5, 6, 7 };
+        checkBVHCoverage(mesh, TetraBVH(mesh));
+    }
 
-    mesh.vertices = {
-                        float4(-0.25, 0.0, 0.0, 0.0), //0
-                        float4(-0.25, 0.25,-0.25, 0.0),//1 
-                        float4(-0.3, 0.0, 0.5, 0.0), //2
-                        float4(-0.5, 0.0, 0.0, 0.0), //3
-
-                        float4(-0.5, 0.25, 0.0, 0.5), //4
-                        float4(-0.35, 0.25, -0.25, 0.5), //5
-                        float4(0.25, 0.0, 0.0, 0.0), //6
-                        float4(0.5, 0.0, 0.0, 0.0) //7
-    };
+    // a mesh file is rendered from its mapping, nothing is copied
+    TetraMeshView view = mesh_cache.is_open() ? mesh_cache.view() : TetraMeshView(mesh);
+
+    // the tree stored in the mesh file, otherwise built and compared with the other builds
+    TetraBVH bvh;
+    if (!mesh_cache.is_open() || !mesh_cache.to_bvh(bvh)) {
+        bvh = TetraBVH(view);
+        BVHBuildOptions median_options;
+        median_options.split = BVH_SPLIT_MEDIAN;
+        TetraBVH median_bvh(view, median_options);
+        BVHBuildOptions morton_options;
+        morton_options.split = BVH_SPLIT_MORTON;
+        TetraBVH morton_bvh(view, morton_options);
+        std::cout << "BVH expected cost: median " << median_bvh.expected_cost() << ", LBVH " << morton_bvh.expected_cost()
+                  << ", SAH " << bvh.expected_cost() << std::endl;
+    }
 
-    mesh.vols = 2;
-    mesh.vertIndex = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    std::vector<float> ao_values;
+    if (!view.ao_values) {
+        ao_values = get_ao4d(view, bvh, 1.0, 25);
+        view.ao_values = ao_values.data();
+    }
 
-    mesh.ao_values = get_ao4d(mesh, 1.0, 25);
+    if (!mesh_cache.is_open() && !mesh_cache_out.empty() && save_tetra_file(mesh_cache_out, view, &bvh, true)) {
+        std::cout << "Wrote " << mesh_cache_out << std::endl;
+    }
 
 
 
     std::string filename = "Renders/testa/z50";
 
-    std::vector<glm::vec3> data = render4d_to_3d_glm(mesh);
+    std::vector<glm::vec3> data = render4d_to_3d_scheduled(view, -1, render_opencl, false, &bvh);
     saveToBinary(filename+"_noao.raw", data);
 
-    std::vector<glm::vec3> data_ao = render4d_ao_to_3d_glm(mesh);
+    std::vector<glm::vec3> data_ao = render4d_ao_to_3d_glm(view, bvh);
     saveToBinary(filename + "_ao.raw", data_ao);
     
-    //std::vector<glm::vec3> data_ao = render4d_ao_to_3d_glm(mesh);
+    //std::vector<glm::vec3> data_ao = render4d_ao_to_3d_glm(view, bvh);
     //saveToBinary(filename + "_min1_ao.raw", data_ao);
 
+#ifdef TRACE_STATS
+    print_trace_stats();
+
+    // per voxel cost of the BVH render
+    saveToBinary(filename + "_cost.raw", render4d_cost_to_3d_glm(view, bvh));
+#endif
+
 
     return 0;
-}
\ No newline at end of file
+}